@@ -0,0 +1,35 @@
+#ifndef WIN32_DPI_TESTS_CHECK_HPP
+#define WIN32_DPI_TESTS_CHECK_HPP
+
+#include <cstdio>
+
+// CHECK
+//  - minimal assertion that reports and counts the failure, but lets the test continue
+//  - tests return Failures () from main
+//
+
+inline int & Failures () {
+    static int n = 0;
+    return n;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf ("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++Failures (); \
+        } \
+    } while (false)
+
+#define CHECK_EQUAL(a, b) \
+    do { \
+        auto a_ = (a); \
+        auto b_ = (b); \
+        if (!(a_ == b_)) { \
+            std::printf ("%s:%d: CHECK failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, \
+                         (long long) a_, (long long) b_); \
+            ++Failures (); \
+        } \
+    } while (false)
+
+#endif
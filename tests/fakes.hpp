@@ -0,0 +1,483 @@
+#ifndef WIN32_DPI_TESTS_FAKES_HPP
+#define WIN32_DPI_TESTS_FAKES_HPP
+
+#include "win32-dpi-cache.hpp"
+#include "win32-dpi-resources.hpp"
+#include "win32-dpi-theme.hpp"
+#include "win32-dpi-update.hpp"
+#include "win32-dpi-visuals.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// fakes
+//  - platform backends for the templates the tests drive, in place of the Win32 ones in win32-dpi.cpp
+//  - like the Win32 side, the state is process-wide: 'resources', 'platform', 'theme' and 'cache' below
+//    are what Resources, ThemeCache and VisualCache are there
+//
+
+inline Resources resources;
+
+// FakePlatform
+//  - every faked platform call goes through Call, which counts it and spins for 'cost' ns,
+//    so that benchmarks can measure the code that makes the calls, not the calls themselves
+//
+struct FakePlatform {
+    long     cost = 0; // ns
+    unsigned calls = 0;
+    volatile long sink = 0;
+
+    long Call (long value = 0, unsigned n = 1) {
+        for (auto i = 0u; i != n; ++i) {
+            ++this->calls;
+            if (this->cost) {
+                auto until = std::chrono::steady_clock::now () + std::chrono::nanoseconds (this->cost);
+                while (std::chrono::steady_clock::now () < until) {}
+            }
+            this->sink = value;
+        }
+        return value;
+    }
+};
+
+inline FakePlatform platform;
+
+struct FakeFont {
+    long lfHeight;
+    long lfWeight;
+};
+struct FakeSize {
+    long cx;
+    long cy;
+};
+struct FakePoint {
+    long x;
+    long y;
+};
+
+// FakeGdi
+//  - handles are just numbers, live objects are remembered with their estimated size
+//  - 'failEvery' makes every n-th creation fail, as if the process ran out of handles
+//
+struct FakeGdi {
+    using Font = FakeFont;
+    using FontHandle = unsigned;
+    using IconHandle = unsigned;
+    using Size = FakeSize;
+
+    static constexpr unsigned Stock = ~0u;
+
+    static inline std::map <unsigned, std::size_t> fonts;
+    static inline std::map <unsigned, std::size_t> icons;
+    static inline unsigned next = 0;
+    static inline unsigned creations = 0;
+    static inline unsigned iconLoads = 0;
+    static inline unsigned failEvery = 0;
+
+    static void Reset () {
+        creations = iconLoads = failEvery = 0;
+    }
+
+    static bool Fail () {
+        ++creations;
+        return failEvery && (creations % failEvery == 0);
+    }
+
+    static unsigned MakeFont (const FakeFont &) {
+        platform.Call ();
+        if (Fail ())
+            return 0;
+        fonts [++next] = Resources::FontBytes;
+        return next;
+    }
+    static void FreeFont (unsigned handle) {
+        platform.Call ();
+        CHECK (handle != Stock);
+        CHECK_EQUAL (fonts.erase (handle), 1u);
+    }
+    static unsigned StockFont (FakeFont & lf) {
+        platform.Call (0, 2); // GetStockObject, GetObject
+        lf = { -11, 400 };
+        return Stock;
+    }
+    static unsigned MakeIcon (FakeSize size) {
+        ++iconLoads;
+        platform.Call (0, 2); // LoadIconWithScaleDown, or FindResource and LoadImage
+        if (Fail ())
+            return 0;
+        icons [++next] = Resources::IconBytes (size.cx, size.cy);
+        return next;
+    }
+    static void FreeIcon (unsigned handle) {
+        platform.Call ();
+        CHECK_EQUAL (icons.erase (handle), 1u);
+    }
+    static class Resources & Accountant () {
+        return resources;
+    }
+};
+
+// FakeThemeBackend
+//  - handles are just numbers, fonts are 9pt/12pt at 96 DPI, system font height and weight can be
+//    changed to emulate SPI_SETNONCLIENTMETRICS, 'themed' false to emulate classic theme
+//  - accounts the handles the way ThemeBackend does
+//
+struct FakeThemeBackend {
+    using Window = const void *;
+    using Handle = unsigned;
+    using Font = FakeFont;
+
+    static inline unsigned opens = 0;
+    static inline unsigned closes = 0;
+    static inline unsigned scaledChecks = 0;
+    static inline unsigned sysFontQueries = 0;
+    static inline unsigned fontQueries = 0;
+    static inline unsigned live = 0;
+    static inline long     sysFontHeight = -12;
+    static inline long     sysFontWeight = 400;
+    static inline bool     themed = true;
+
+    static void Reset () {
+        opens = closes = scaledChecks = sysFontQueries = fontQueries = 0;
+        sysFontHeight = -12;
+        sysFontWeight = 400;
+        themed = true;
+    }
+
+    static bool IsScaled (Window) {
+        ++scaledChecks;
+        return platform.Call (false); // theme fonts are at 96 DPI, BasicThemeCache scales them
+    }
+    static Handle Open (Window, const wchar_t *, unsigned, bool) {
+        platform.Call ();
+        if (themed) {
+            return ++opens;
+        } else
+            return 0;
+    }
+    static void Close (Handle) {
+        platform.Call ();
+        ++closes;
+    }
+    static bool GetSysFont (Handle, int, Font & font) {
+        ++sysFontQueries;
+        font = { platform.Call (sysFontHeight), sysFontWeight };
+        return true;
+    }
+    static bool GetFont (Handle handle, int, int, int, Font & font) {
+        ++fontQueries;
+        platform.Call ();
+        if (handle) {
+            font = { -16, 700 };
+            return true;
+        } else
+            return false;
+    }
+    static void Scale (Font & font, unsigned dpi) {
+        font.lfHeight = font.lfHeight * long (dpi) / 96;
+    }
+    static unsigned Tick () {
+        return resources.Tick ();
+    }
+    static bool CanGrow () {
+        return resources.Fits (Resources::ThemeResource, Resources::ThemeBytes);
+    }
+    static void Opened (unsigned dpi) {
+        ++live;
+        resources.Add (Resources::ThemeResource, dpi, Resources::ThemeBytes);
+    }
+    static void Closed (unsigned dpi) {
+        CHECK (live != 0);
+        --live;
+        resources.Remove (Resources::ThemeResource, dpi, Resources::ThemeBytes);
+    }
+};
+
+inline BasicThemeCache <FakeThemeBackend> theme;
+
+// FakeWindow
+//  - parent window with child controls, as seen by the controls themselves
+//
+struct FakeWindow {
+    struct Control {
+        std::wstring text;
+        unsigned     font = 0;
+        bool         visible = true; // WS_VISIBLE
+        FakePoint    position = { 0, 0 };
+    };
+
+    bool visible = true;
+    bool redraw = true;
+    std::map <unsigned, Control> controls;
+    std::map <unsigned, unsigned> icons;
+
+    unsigned sends = 0; // synchronous messages and EndDeferWindowPos
+    unsigned queries = 0; // style reads
+    unsigned repaints = 0;
+    bool     deferring = false;
+
+    void Reset () {
+        sends = queries = repaints = 0;
+    }
+};
+
+// FakeControlBackend
+//  - backend of BasicUpdate, counts round-trips, queries and repaints on the FakeWindow
+//
+struct FakeControlBackend {
+    using Handle = unsigned;
+    using Point = FakePoint;
+    using Size = FakeSize;
+
+    FakeWindow * window;
+
+    bool IsVisible () const {
+        return this->window->visible;
+    }
+    bool IsControlVisible (unsigned id) const {
+        platform.Call ();
+        ++this->window->queries;
+        return this->window->controls [id].visible;
+    }
+    void SetRedraw (bool redraw) {
+        this->Send ();
+        this->window->redraw = redraw;
+    }
+    void Redraw () {
+        ++this->window->repaints;
+    }
+    void SetText (unsigned id, const wchar_t * text) {
+        this->Send ();
+        this->window->controls [id].text = text;
+        this->Repaint ();
+    }
+    void SetFont (unsigned id, unsigned font) {
+        this->Send ();
+        this->window->controls [id].font = font; // WM_SETFONT with FALSE, no repaint
+    }
+    void SetIcon (unsigned type, unsigned icon) {
+        this->Send ();
+        this->window->icons [type] = icon;
+    }
+    void BeginDefer (unsigned) {
+        platform.Call ();
+        this->window->deferring = true;
+    }
+    void DeferPosition (unsigned id, const FakePoint & position, const FakeSize &, bool redraw) {
+        CHECK (this->window->deferring);
+        platform.Call ();
+        this->window->controls [id].position = position;
+        if (redraw) {
+            this->Repaint ();
+        }
+    }
+    void DeferVisibility (unsigned id, bool visible, bool redraw) {
+        CHECK (this->window->deferring);
+        platform.Call ();
+        this->window->controls [id].visible = visible;
+        if (redraw) {
+            this->Repaint ();
+        }
+    }
+    void EndDefer () {
+        this->Send ();
+        this->window->deferring = false;
+    }
+
+private:
+    void Send () {
+        platform.Call ();
+        ++this->window->sends;
+    }
+    void Repaint () {
+        if (this->window->redraw && this->window->visible) {
+            ++this->window->repaints;
+        }
+    }
+};
+
+// FakeVisualCache
+//  - VisualCacheStore with the file mapped by mmap instead of CreateFileMapping, see VisualCache
+//
+struct FakeVisualCache {
+    using Format = VisualCacheFormat;
+
+    VisualCacheStore store;
+    std::uint64_t    fingerprint = 0;
+    void *           view = MAP_FAILED;
+    std::size_t      size = 0;
+
+    bool Map (const char * path, std::uint64_t fingerprint) {
+        this->fingerprint = fingerprint;
+
+        auto fd = open (path, O_RDONLY);
+        if (fd != -1) {
+            struct stat st;
+            if (fstat (fd, &st) == 0 && st.st_size > 0 && std::size_t (st.st_size) <= Format::MaxFileSize) {
+                this->size = std::size_t (st.st_size);
+                this->view = mmap (nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            close (fd);
+        }
+        if (this->view != MAP_FAILED) {
+            if (Format::Validate (this->view, this->size, this->fingerprint) == Format::Status::Valid) {
+                this->store.Attach (this->view);
+                return true;
+            }
+            this->Unmap ();
+        }
+        return false;
+    }
+
+    // Flush
+    //  - returns true if the file was written
+    //
+    bool Flush (const char * path) {
+        if (!this->store.IsDirty ())
+            return false;
+
+        static unsigned char buffer [Format::MaxFileSize];
+        auto cb = this->store.Serialize (buffer, this->fingerprint);
+        this->Unmap ();
+
+        std::string temporary = std::string (path) + ".tmp";
+        if (auto f = std::fopen (temporary.c_str (), "wb")) {
+            auto written = std::fwrite (buffer, 1, cb, f) == cb;
+            std::fclose (f);
+            if (written && std::rename (temporary.c_str (), path) == 0) {
+                this->store.Written ();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Close
+    //  - process exit, drops everything
+    //
+    void Close () {
+        this->Unmap ();
+        this->store.Clear ();
+    }
+
+private:
+    void Unmap () {
+        this->store.Detach ();
+        if (this->view != MAP_FAILED) {
+            munmap (this->view, this->size);
+            this->view = MAP_FAILED;
+        }
+    }
+};
+
+inline FakeVisualCache cache;
+
+// FakeVisualsBackend
+//  - backend of BasicVisuals, over the fakes above, metrics are the 96 DPI values scaled to 'dpi'
+//
+struct FakeVisualsBackend {
+    using Window = FakeWindow *;
+    using Font = FakeFont;
+    using Gdi = FakeGdi;
+    using Controls = FakeControlBackend;
+
+    static constexpr int MetricsCount = 97; // SM_CMETRICS
+    static constexpr int LiveMetrics [] = { 16, 17, 61, 62, 67, 63 }; // work area and session state
+    static constexpr int CyBorder = 6;
+    static constexpr int CxIcon = 11;
+    static constexpr int CyIcon = 12;
+    static constexpr int CxSmallIcon = 49;
+    static constexpr int CySmallIcon = 50;
+
+    static constexpr unsigned SmallIcon = 0;
+    static constexpr unsigned BigIcon = 1;
+    static constexpr unsigned SmallIcon2 = 2;
+    static constexpr unsigned OkButton = 1;
+
+    static inline unsigned      metricQueries = 0;
+    static inline unsigned      dpiSystem = 96;
+    static inline unsigned long textScale = 100;
+    static inline bool          windows10 = true;
+
+    static void Reset () {
+        metricQueries = 0;
+        dpiSystem = 96;
+        textScale = 100;
+        windows10 = true;
+    }
+
+    static unsigned SystemDpi () {
+        return unsigned (platform.Call (dpiSystem));
+    }
+    static int Metric (int index, long dpi, unsigned) {
+        ++metricQueries;
+        switch (index) {
+            case CxIcon:
+            case CyIcon:
+                return int (platform.Call (32 * dpi / 96));
+            case CxSmallIcon:
+            case CySmallIcon:
+                return int (platform.Call (16 * dpi / 96));
+            case CyBorder:
+                return int (platform.Call (dpi / 96));
+            default:
+                return int (platform.Call (index * dpi / 96));
+        }
+    }
+    static bool IsWindows10 () {
+        return windows10;
+    }
+
+    static const VisualCacheFormat::Record * Find (long dpi) {
+        return cache.store.Find (dpi);
+    }
+    static void Store (const VisualCacheFormat::Record & record) {
+        cache.store.Store (record);
+    }
+    static VisualCacheFormat::Font Pack (const FakeFont & lf) {
+        VisualCacheFormat::Font font = {};
+        font.height = std::int32_t (lf.lfHeight);
+        font.weight = std::int32_t (lf.lfWeight);
+        return font;
+    }
+    static FakeFont Unpack (const VisualCacheFormat::Font & font) {
+        return { font.height, font.weight };
+    }
+
+    static bool TextFont (FakeWindow * window, long dpi, FakeFont & lf) {
+        return theme.GetSysFont (window, L"TEXTSTYLE", unsigned (dpi), 805, lf); // TMT_MSGBOXFONT
+    }
+    static bool TitleFont (FakeWindow * window, long dpi, FakeFont & lf) {
+        return theme.GetFont (window, L"TEXTSTYLE", unsigned (dpi), 1, 0, 210, lf); // TEXT_MAININSTRUCTION, TMT_FONT
+    }
+    static bool DefaultFont (FakeFont & lf) {
+        platform.Call (0, 2); // GetStockObject, GetObject
+        lf = { -11, 400 };
+        return true;
+    }
+    static void Scale (FakeFont & lf, long dpi, unsigned dpiSystem) {
+        lf.lfHeight = lf.lfHeight * dpi / long (dpiSystem);
+    }
+    static void Bold (FakeFont & lf) {
+        lf.lfWeight = 700;
+    }
+
+    static void ApplyTextScale (FakeFont & lf) {
+        lf.lfHeight = lf.lfHeight * long (textScale) / 100;
+    }
+    static unsigned long TextScaleFactor () {
+        return textScale;
+    }
+};
+
+using FakeVisuals = BasicVisuals <FakeVisualsBackend>;
+
+#endif
@@ -0,0 +1,346 @@
+#include "fakes.hpp"
+
+#include <cstdio>
+#include <vector>
+
+// resources-soak
+//  - drives BasicVisuals (its fonts, icons and icon cache) and BasicThemeCache, as Window does,
+//    through days of simulated DPI, theme and settings changes, taskbar icon requests for
+//    many DPIs, minimizing and memory pressure, with small budgets so that trimming happens
+//  - after every event Resources accounting must match the handles the fake backends hold,
+//    per DPI usage must add up to the totals, and hard budget must never be exceeded
+//  - also the trimming policy: pinned-only usage doesn't schedule trimming, icon loaded just
+//    before the trimming survives it, WM_COMPACTING from every window trims only once
+//
+
+namespace {
+
+    // SoakWindow
+    //  - Window, as far as resources are concerned: its BasicVisuals, over fake controls
+    //
+    struct SoakWindow {
+        FakeWindow  controls;
+        FakeVisuals visuals;
+
+        explicit SoakWindow (long dpi)
+            : visuals (&this->controls, dpi) {};
+    };
+
+    std::vector <SoakWindow *> windows;
+    unsigned scheduled = 0; // pending timer, see Window::Initialize
+    unsigned schedules = 0;
+    unsigned trims = 0;
+
+    void Trim (unsigned before) {
+        ++trims;
+        theme.Trim (before);
+        for (auto window : windows) {
+            window->visuals.Trim (before);
+        }
+    }
+
+    // Pump
+    //  - message loop, dispatches the pending ResourcePressureTimer
+    //
+    void Pump () {
+        if (scheduled) {
+            scheduled = 0;
+            resources.RunScheduled ();
+        }
+    }
+
+    void Reset (Resources::Budget soft, Resources::Budget hard) {
+        for (auto window : windows) {
+            delete window;
+        }
+        windows.clear ();
+        theme.Invalidate ();
+
+        resources = Resources ();
+        resources.soft = soft;
+        resources.hard = hard;
+        resources.schedule = [] () { ++scheduled; ++schedules; };
+        resources.trim = Trim;
+
+        cache.Close ();
+        FakeGdi::Reset ();
+        FakeThemeBackend::Reset ();
+        FakeVisualsBackend::Reset ();
+        scheduled = schedules = trims = 0;
+    }
+
+    // Verify
+    //  - accounting matches what the backends hold
+    //
+    bool Verify () {
+        auto failures = Failures ();
+        auto total = resources.Total ();
+
+        std::size_t bytes = FakeThemeBackend::live * Resources::ThemeBytes;
+        for (const auto & [handle, size] : FakeGdi::fonts) {
+            bytes += size;
+        }
+        for (const auto & [handle, size] : FakeGdi::icons) {
+            bytes += size;
+        }
+        CHECK_EQUAL (total.gdi, FakeGdi::fonts.size () + 2 * FakeGdi::icons.size ());
+        CHECK_EQUAL (total.user, FakeGdi::icons.size ());
+        CHECK_EQUAL (total.other, FakeThemeBackend::live);
+        CHECK_EQUAL (total.bytes, bytes);
+
+        for (auto type = 0u; type != Resources::ResourceTypesCount; ++type) {
+            Resources::Usage sum;
+            for (const auto & entry : resources.dpis) {
+                sum += entry.usage [type];
+            }
+            CHECK_EQUAL (sum.gdi, resources.total [type].gdi);
+            CHECK_EQUAL (sum.user, resources.total [type].user);
+            CHECK_EQUAL (sum.other, resources.total [type].other);
+            CHECK_EQUAL (sum.bytes, resources.total [type].bytes);
+        }
+
+        Resources::Usage pinned;
+        for (auto window : windows) {
+            for (auto font : { &window->visuals.fonts.text, &window->visuals.fonts.title }) {
+                if (font->dpi) {
+                    pinned += Resources::Cost (Resources::FontResource, Resources::FontBytes);
+                }
+            }
+            for (auto icon : { &window->visuals.icons.small, &window->visuals.icons.big }) {
+                if (icon->handle && icon->pinned) {
+                    pinned += Resources::Cost (Resources::IconResource, Resources::IconBytes (icon->size.cx, icon->size.cy));
+                }
+            }
+        }
+        CHECK_EQUAL (resources.pinned.gdi, pinned.gdi);
+        CHECK_EQUAL (resources.pinned.user, pinned.user);
+        CHECK_EQUAL (resources.pinned.bytes, pinned.bytes);
+
+        CHECK (total.gdi <= resources.hard.gdi);
+        CHECK (total.user <= resources.hard.user);
+        CHECK (total.bytes <= resources.hard.bytes);
+        return Failures () == failures;
+    }
+
+    SoakWindow * Open (long dpi) {
+        auto window = new SoakWindow (dpi);
+        windows.push_back (window);
+        window->visuals.Refresh ();
+        return window;
+    }
+
+    void TestPinnedOnly () {
+        Reset ({ 1, 1, 1 << 24 }, { 1000, 1000, 1 << 24 });
+
+        // fonts and the pair of window icons alone are over soft budget, but there's nothing to trim
+        Open (96);
+        Pump ();
+        CHECK_EQUAL (schedules, 0u);
+        CHECK_EQUAL (trims, 0u);
+        CHECK (resources.IsOverBudget (resources.soft));
+        CHECK (!resources.NeedsTrim (resources.soft));
+        CHECK (Verify ());
+    }
+
+    void TestCutoff () {
+        Reset ({ 1, 1, 1 << 24 }, { 1000, 1000, 1 << 24 });
+        auto window = Open (96);
+
+        // icon for other DPI gets usage over soft budget, but it's about to be used, so it survives
+        auto first = window->visuals.GetIcon (1, 144);
+        CHECK (first != 0);
+        CHECK_EQUAL (schedules, 1u);
+        Pump ();
+        CHECK (trims <= 4u);
+        CHECK_EQUAL (resources.Trimmable ().user, 1u);
+
+        // next one does the same, the older one, no longer in use, is trimmed
+        auto second = window->visuals.GetIcon (1, 192);
+        CHECK (second != 0);
+        CHECK_EQUAL (schedules, 2u);
+        Pump ();
+        CHECK_EQUAL (resources.Trimmable ().user, 1u);
+        CHECK_EQUAL (window->visuals.GetIcon (1, 192), second);
+        CHECK (Verify ());
+    }
+
+    void TestCompacting () {
+        Reset ({ 1000, 1000, 1 << 24 }, { 4000, 4000, 1 << 26 });
+        for (auto i = 0; i != 8; ++i) {
+            auto window = Open (96 + 24 * i);
+            window->visuals.GetIcon (1, 288);
+        }
+        Pump ();
+        CHECK_EQUAL (schedules, 0u);
+
+        // every top-level window receives WM_COMPACTING
+        for (auto i = 0u; i != windows.size (); ++i) {
+            resources.Schedule (true);
+        }
+        Pump ();
+        CHECK_EQUAL (schedules, 1u);
+        CHECK_EQUAL (trims, 1u);
+        CHECK_EQUAL (resources.Trimmable ().user, 0u);
+        CHECK_EQUAL (resources.Trimmable ().gdi, 0u);
+        CHECK_EQUAL (resources.total [Resources::ThemeResource].other, 0u);
+        CHECK (Verify ());
+    }
+
+    void TestHardBudget () {
+        Reset ({ 1000, 1000, 1 << 24 }, { 1000, 2, 1 << 24 });
+        auto window = Open (96);
+        CHECK_EQUAL (resources.Total ().user, 2u);
+
+        // pinned icons take the whole USER budget, other icons are denied after trimming everything
+        CHECK_EQUAL (window->visuals.GetIcon (1, 144), 0u);
+        CHECK_EQUAL (trims, 1u);
+        CHECK (Verify ());
+
+        // fonts are GDI objects only, when denied, the current font is kept
+        resources.hard.gdi = resources.Total ().gdi;
+        auto handle = window->visuals.fonts.text.handle;
+        auto height = window->visuals.fonts.text.height;
+        FakeThemeBackend::sysFontHeight = -15;
+        theme.InvalidateSystemFonts ();
+        window->visuals.Refresh (true);
+        CHECK_EQUAL (window->visuals.fonts.text.handle, handle);
+        CHECK_EQUAL (window->visuals.fonts.text.height, height); // describes the font the controls have, not the requested one
+        CHECK (Verify ());
+
+        // new window gets stock font
+        auto second = Open (96);
+        CHECK_EQUAL (second->visuals.fonts.text.handle, FakeGdi::Stock);
+        CHECK_EQUAL (second->visuals.fonts.text.dpi, 0);
+        CHECK_EQUAL (second->visuals.fonts.text.height, 96 * 11 / 72);
+        CHECK (Verify ());
+    }
+
+    // TestSoak
+    //  - 8 windows, event every 10 seconds for 3 days
+    //
+    void TestSoak () {
+        Reset ({ 60, 24, 256 * 1024 }, { 100, 40, 1024 * 1024 });
+        FakeGdi::failEvery = 97;
+
+        const auto days = 3u;
+        const auto events = days * 24 * 60 * 60 / 10;
+
+        long dpis [40];
+        for (auto i = 0u; i != 40; ++i) {
+            dpis [i] = 96 + 12 * i;
+        }
+
+        std::uint32_t seed = 1;
+        auto random = [&seed] (unsigned n) {
+            seed = seed * 1664525u + 1013904223u;
+            return (seed >> 8) % n;
+        };
+
+        for (auto i = 0u; i != 8; ++i) {
+            Open (dpis [random (4)]);
+        }
+
+        auto drift = 0u;
+        auto denied = 0u;
+        auto peak = Resources::Usage ();
+        for (auto event = 0u; event != events; ++event) {
+            auto window = windows [random (unsigned (windows.size ()))];
+            auto kind = random (100);
+
+            if (kind < 50) {
+                // taskbar on another display, at one of 40 DPIs, more than Resources has entries for
+                auto ndpi = dpis [random (40)];
+                if ((ndpi != window->visuals.dpi) && !window->visuals.GetIcon (random (3), ndpi)) {
+                    ++denied;
+                }
+            } else
+            if (kind < 60) {
+                window->visuals.dpi = dpis [random (8)];
+                window->visuals.Refresh ();
+            } else
+            if (kind < 63) {
+                FakeThemeBackend::sysFontHeight = -11 - long (random (4));
+                theme.InvalidateSystemFonts ();
+                for (auto w : windows) {
+                    w->visuals.Refresh (true);
+                }
+            } else
+            if (kind < 64) {
+                theme.Invalidate ();
+                for (auto w : windows) {
+                    w->visuals.Refresh (true);
+                }
+            } else
+            if (kind < 69) {
+                window->visuals.Trim (resources.Now () + 1);
+            } else
+            if (kind < 70) {
+                for (auto i = 0u; i != windows.size (); ++i) {
+                    resources.Schedule (true);
+                }
+            } else
+            if (kind < 73) {
+                for (auto & w : windows) {
+                    if (w == window) {
+                        delete w;
+                        w = new SoakWindow (dpis [random (8)]);
+                        w->visuals.Refresh ();
+                        break;
+                    }
+                }
+            }
+            Pump ();
+
+            auto total = resources.Total ();
+            if (total.gdi > peak.gdi) peak.gdi = total.gdi;
+            if (total.user > peak.user) peak.user = total.user;
+            if (total.bytes > peak.bytes) peak.bytes = total.bytes;
+
+            if (!Verify ()) {
+                std::printf ("accounting drift after event %u\n", event);
+                if (++drift == 10)
+                    break;
+            }
+        }
+
+        std::printf ("%u days, %u events: peak %u GDI, %u USER, %zu bytes; %u trims scheduled, %u passes, %u denied\n",
+                     days, events, peak.gdi, peak.user, peak.bytes, schedules, trims, denied);
+
+        CHECK_EQUAL (drift, 0u);
+        CHECK (schedules != 0);
+        CHECK (peak.gdi <= resources.hard.gdi);
+        CHECK (peak.user <= resources.hard.user);
+
+        // everything released, nothing left accounted anywhere
+        for (auto window : windows) {
+            delete window;
+        }
+        windows.clear ();
+        theme.Invalidate ();
+
+        CHECK (Verify ());
+        CHECK (FakeGdi::fonts.empty ());
+        CHECK (FakeGdi::icons.empty ());
+        CHECK_EQUAL (FakeThemeBackend::live, 0u);
+        CHECK_EQUAL (resources.Total ().gdi, 0u);
+        CHECK_EQUAL (resources.Total ().user, 0u);
+        CHECK_EQUAL (resources.Total ().other, 0u);
+        CHECK_EQUAL (resources.Total ().bytes, std::size_t (0));
+        CHECK_EQUAL (resources.pinned.gdi, 0u);
+        for (const auto & entry : resources.dpis) {
+            for (const auto & usage : entry.usage) {
+                CHECK_EQUAL (usage.gdi + usage.user + usage.other + usage.bytes, std::size_t (0));
+            }
+        }
+    }
+}
+
+int main () {
+    TestPinnedOnly ();
+    TestCutoff ();
+    TestCompacting ();
+    TestHardBudget ();
+    TestSoak ();
+    Reset ({ 0, 0, 0 }, { 0, 0, 0 });
+    return Failures ();
+}
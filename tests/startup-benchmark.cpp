@@ -0,0 +1,297 @@
+#include "win32-dpi-startup.hpp"
+#include "fakes.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+// startup-benchmark
+//  - BasicStartup, with the main window's BasicVisuals, over fake backends: time to first frame,
+//    and platform calls made before it (critical path) and after it, cold (no cache file) and warm
+//  - Win32 work outside of the shared code (symbols, cache fingerprint, text scale registry reads,
+//    window creation) is faked in FakeStartupBackend, one platform call per API call
+//  - VisualCache.Initialize (path, fingerprint, map and validate) is broken out, read from the same
+//    milestones BasicStartupTrace prints with -trace
+//  - checks what the order must guarantee regardless of call costs: deferred work happens after
+//    ShowWindow, metrics are queried once, only the two window icons are loaded, warm start takes
+//    everything it can from the cache and doesn't rewrite it
+//  - every fake call costs the same, optional argument is the cost of one call in ns, 1000 by
+//    default; the cache file is real
+//
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct SteadyTraceBackend {
+        static bool Frequency (std::int64_t & frequency) {
+            frequency = std::int64_t (std::chrono::nanoseconds (std::chrono::seconds (1)).count ());
+            return true;
+        }
+        static std::int64_t Now () {
+            return std::chrono::duration_cast <std::chrono::nanoseconds> (Clock::now ().time_since_epoch ()).count ();
+        }
+        static inline bool print = false;
+        static void Output (const wchar_t * text) {
+            if (print) {
+                std::printf ("  %ls", text);
+            }
+        }
+    };
+
+    // Process
+    //  - what one run of the application leaves behind: its trace, main window, and the steps
+    //    FakeStartupBackend was asked to do, in order
+    //
+    struct Process {
+        enum Step { Map, ReadScale, Create, Show, Schedule, Watch, Flush };
+
+        const char * path;
+        BasicStartupTrace <SteadyTraceBackend> trace;
+        std::unique_ptr <FakeWindow> window;
+        std::unique_ptr <FakeVisuals> visuals;
+        std::vector <Step> steps;
+        bool written = false;
+
+        explicit Process (const char * path)
+            : path (path) {};
+
+        std::size_t Index (Step step) const {
+            for (auto i = 0u; i != this->steps.size (); ++i) {
+                if (this->steps [i] == step)
+                    return i;
+            }
+            return std::size_t (-1);
+        }
+    };
+
+    // FakeStartupBackend
+    //  - StartupBackend, with the window procedure of the main window inlined into CreateMainWindow
+    //    and ShowMainWindow
+    //
+    struct FakeStartupBackend {
+        Process * process;
+
+        void Event (const wchar_t * event) {
+            this->process->trace.Event (event);
+        }
+        void LoadSymbols () {
+            platform.Call (0, 1 + 8); // InitCommonControls, GetModuleHandle and GetProcAddress
+        }
+        bool MapVisualCache () {
+            this->process->steps.push_back (Process::Map);
+
+            platform.Call (0, 2); // GetEnvironmentVariable, swprintf
+            this->Event (L"visual cache path");
+
+            platform.Call (0, 31); // RtlGetVersion, GetDpiForSystem, IsThemeActive, GetCurrentThemeName, 3x SPI, 24 metrics
+            this->Event (L"visual cache fingerprint");
+
+            platform.Call (0, 4); // CreateFile, GetFileSizeEx, CreateFileMapping, MapViewOfFile
+            return cache.Map (this->process->path, 0x5EED);
+        }
+        bool ReadTextScale () {
+            this->process->steps.push_back (Process::ReadScale);
+            platform.Call (0, 6); // IsWindows10OrGreater, CreateEvent, 2x RegOpenKeyEx, RegQueryValueEx, RegNotifyChangeKeyValue
+            return true;
+        }
+        bool CreateMainWindow () {
+            this->process->steps.push_back (Process::Create);
+            platform.Call (0, 2); // RegisterClassEx, CreateWindow
+
+            this->process->window.reset (new FakeWindow);
+            this->process->visuals.reset (new FakeVisuals (this->process->window.get (), 144));
+
+            platform.Call (0, 2); // WM_NCCREATE: EnableNonClientDpiScaling, GetDpiForWindow
+            this->process->visuals->RefreshMetrics ();
+            this->Event (L"WM_NCCREATE");
+
+            platform.Call (0, 4 + 1); // WM_CREATE: child windows, GetDpiForWindow
+            this->process->visuals->Refresh ();
+            platform.Call (); // LoadCursor
+            this->Event (L"WM_CREATE");
+            return true;
+        }
+        void ShowMainWindow () {
+            this->process->steps.push_back (Process::Show);
+            platform.Call (0, 2); // ShowWindow, GetClientRect in WM_WINDOWPOSCHANGED
+            this->process->visuals->Layout (800, 600);
+            platform.Call (); // first WM_PAINT
+        }
+        void ScheduleIdle () {
+            this->process->steps.push_back (Process::Schedule);
+            platform.Call (); // SetTimer
+        }
+        void WatchTextScale () {
+            this->process->steps.push_back (Process::Watch);
+            platform.Call (); // RegisterWaitForSingleObject
+        }
+        void FlushVisualCache () {
+            this->process->steps.push_back (Process::Flush);
+            if (cache.store.IsDirty ()) {
+                platform.Call (0, 4); // CreateFile, WriteFile, CloseHandle, MoveFileEx
+            }
+            this->process->written = cache.Flush (this->process->path);
+        }
+    };
+
+    struct Result {
+        unsigned critical = 0; // platform calls before first frame
+        unsigned deferred = 0; // after it
+        unsigned metricQueries = 0; // before first frame
+        unsigned themeOpens = 0;
+        unsigned iconLoads = 0;
+        unsigned written = 0;
+        double   firstFrame = 0.0; // ms
+        double   visualCache = 0.0; // ms in VisualCache.Initialize
+        double   startup = 0.0; // ms until everything is done
+    };
+
+    // Startup
+    //  - wWinMain up to the first frame, then the first idle message loop iteration
+    //
+    Result Startup (const char * path, bool print = false) {
+        Result result;
+        resources = Resources ();
+        FakeGdi::Reset ();
+        FakeThemeBackend::Reset ();
+        FakeVisualsBackend::Reset ();
+        SteadyTraceBackend::print = print;
+
+        Process process (path);
+        process.trace.Enable (true);
+
+        auto calls = platform.calls;
+        CHECK (BasicStartup <FakeStartupBackend> ({ &process }).Run ());
+        result.critical = platform.calls - calls;
+        result.metricQueries = FakeVisualsBackend::metricQueries;
+        result.themeOpens = FakeThemeBackend::opens;
+        result.iconLoads = FakeGdi::iconLoads;
+
+        // WM_TIMER, see StartupBackend::ScheduleIdle
+        CHECK_EQUAL (process.Index (Process::Schedule), process.steps.size () - 1);
+        BasicStartup <FakeStartupBackend> ({ &process }).Idle ();
+        result.deferred = platform.calls - calls - result.critical;
+        result.written = process.written;
+
+        CHECK (process.Index (Process::Map) < process.Index (Process::Create));
+        CHECK (process.Index (Process::ReadScale) < process.Index (Process::Create));
+        CHECK (process.Index (Process::Watch) > process.Index (Process::Show));
+        CHECK (process.Index (Process::Flush) > process.Index (Process::Show));
+        CHECK_EQUAL (process.steps.size (), std::size_t (7));
+
+        result.firstFrame = process.trace.Elapsed (L"first idle");
+        auto mapped = process.trace.Elapsed (L"visual cache mapped");
+        if (mapped < 0.0) {
+            mapped = process.trace.Elapsed (L"visual cache not available");
+        }
+        result.visualCache = mapped - process.trace.Elapsed (L"symbols");
+        result.startup = process.trace.Elapsed (L"deferred work done");
+
+        // process exit, OS cleans up, but what the fakes hold is released
+        process.visuals.reset ();
+        theme.Invalidate ();
+        cache.Close ();
+
+        SteadyTraceBackend::print = false;
+        return result;
+    }
+
+    // TestArguments
+    //  - "-trace" must be a whole argument
+    //
+    void TestArguments () {
+        CHECK (HasArgument (L"-trace", L"-trace"));
+        CHECK (HasArgument (L"  -trace  ", L"-trace"));
+        CHECK (HasArgument (L"file.txt -trace", L"-trace"));
+        CHECK (HasArgument (L"-trace\tfile.txt", L"-trace"));
+        CHECK (HasArgument (L"\"-trace\"", L"-trace"));
+        CHECK (HasArgument (L"\"my file.txt\" -trace", L"-trace"));
+        CHECK (!HasArgument (nullptr, L"-trace"));
+        CHECK (!HasArgument (L"", L"-trace"));
+        CHECK (!HasArgument (L"-tracer", L"-trace"));
+        CHECK (!HasArgument (L"no-trace", L"-trace"));
+        CHECK (!HasArgument (L"\"my -trace file.txt\"", L"-trace"));
+        CHECK (!HasArgument (L"c:\\logs\\x-trace.txt", L"-trace"));
+        CHECK (!HasArgument (L"-trac", L"-trace"));
+    }
+
+    void Accumulate (Result & total, const Result & result) {
+        total.critical += result.critical;
+        total.deferred += result.deferred;
+        total.metricQueries += result.metricQueries;
+        total.themeOpens += result.themeOpens;
+        total.iconLoads += result.iconLoads;
+        total.written += result.written;
+        total.firstFrame += result.firstFrame;
+        total.visualCache += result.visualCache;
+        total.startup += result.startup;
+    }
+
+    void Report (const char * what, const Result & total, int n) {
+        std::printf ("  %-5s %8.3f ms first frame, %8.3f ms all done, %8.3f ms visual cache; %5u calls before first frame, %4u after\n",
+                     what, total.firstFrame / n, total.startup / n, total.visualCache / n, total.critical / n, total.deferred / n);
+    }
+}
+
+int main (int argc, char ** argv) {
+    TestArguments ();
+
+    platform.cost = 1000;
+    if (argc > 1) {
+        platform.cost = std::atol (argv [1]);
+    }
+
+    char path [] = "/tmp/win32-dpi-startup-XXXXXX";
+    auto fd = mkstemp (path);
+    if (fd == -1)
+        return 1;
+    close (fd);
+
+    // trace of one warm startup, as printed with -trace
+
+    unlink (path);
+    Startup (path);
+    std::printf ("warm startup trace, fake call cost %ld ns:\n", platform.cost);
+    auto traced = Startup (path, true);
+    CHECK (traced.firstFrame > 0.0);
+    CHECK (traced.visualCache > 0.0);
+    CHECK (traced.visualCache < traced.firstFrame);
+
+    const int iterations = 200;
+    Result results [2]; // [warm]
+
+    for (auto i = 0; i != iterations; ++i) {
+        unlink (path);
+        Accumulate (results [0], Startup (path));
+        Accumulate (results [1], Startup (path));
+    }
+    unlink (path);
+
+    std::printf ("startup, %d runs each:\n", iterations);
+    Report ("cold", results [0], iterations);
+    Report ("warm", results [1], iterations);
+
+    const auto & cold = results [0];
+    const auto & warm = results [1];
+    const auto live = unsigned (sizeof FakeVisualsBackend::LiveMetrics / sizeof FakeVisualsBackend::LiveMetrics [0]);
+
+    // metrics queried once (WM_NCCREATE), not again in WM_CREATE; warm start queries only what's never cached
+    CHECK_EQUAL (cold.metricQueries, unsigned (iterations * FakeVisualsBackend::MetricsCount));
+    CHECK_EQUAL (warm.metricQueries, unsigned (iterations * live));
+
+    // fonts from the cache, without opening the theme
+    CHECK_EQUAL (cold.themeOpens, unsigned (iterations));
+    CHECK_EQUAL (warm.themeOpens, 0u);
+
+    // only the small and big window icons, other sizes are loaded when asked for
+    CHECK_EQUAL (cold.iconLoads, unsigned (iterations * 2));
+    CHECK_EQUAL (warm.iconLoads, unsigned (iterations * 2));
+
+    // cold start writes the cache file, warm start has nothing new to write
+    CHECK_EQUAL (cold.written, unsigned (iterations));
+    CHECK_EQUAL (warm.written, 0u);
+    CHECK (warm.critical < cold.critical);
+    CHECK_EQUAL (warm.deferred, unsigned (iterations)); // RegisterWaitForSingleObject only
+    return Failures ();
+}
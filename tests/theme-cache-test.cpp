@@ -0,0 +1,187 @@
+#include "fakes.hpp"
+
+#include <cstdio>
+#include <initializer_list>
+
+// theme-cache-test
+//  - counts theme opens and queries made by BasicThemeCache when refreshing 1..500 windows,
+//    the way BasicVisuals::ResolveFonts does (one system font and one theme font per window)
+//  - system font invalidation on settings change, and replacement of free and LRU entries
+//
+
+namespace {
+    using ThemeCache = BasicThemeCache <FakeThemeBackend>;
+    using B = FakeThemeBackend;
+
+    void Reset () {
+        resources = Resources ();
+        B::Reset ();
+    }
+
+    const int TMT_MSGBOXFONT = 805;
+    const int TEXT_MAININSTRUCTION = 1;
+    const int TMT_FONT = 210;
+
+    // Refresh
+    //  - what BasicVisuals::ResolveFonts does for each of 'n' windows
+    //
+    void Refresh (ThemeCache & cache, unsigned n, const unsigned * dpis, unsigned ndpis, FakeFont * last = nullptr) {
+        for (auto i = 0u; i != n; ++i) {
+            FakeFont text, title;
+            auto dpi = dpis [i % ndpis];
+            cache.GetSysFont (nullptr, L"TEXTSTYLE", dpi, TMT_MSGBOXFONT, text);
+            cache.GetFont (nullptr, L"TEXTSTYLE", dpi, TEXT_MAININSTRUCTION, 0, TMT_FONT, title);
+            if (last) {
+                *last = text;
+            }
+        }
+    }
+
+    void TestSameDpi () {
+        std::printf ("windows  opens  scaled-checks  queries\n");
+        for (auto n : { 1u, 2u, 10u, 100u, 500u }) {
+            Reset ();
+            ThemeCache cache;
+            const unsigned dpi [] = { 144 };
+            Refresh (cache, n, dpi, 1);
+
+            std::printf ("%7u  %5u  %13u  %7u\n", n, B::opens, B::scaledChecks, B::sysFontQueries + B::fontQueries);
+            CHECK_EQUAL (B::opens, 1u);
+            CHECK_EQUAL (B::scaledChecks, 1u);
+            CHECK_EQUAL (B::sysFontQueries, 1u);
+            CHECK_EQUAL (B::fontQueries, 1u);
+
+            // second refresh of all windows costs nothing
+            Refresh (cache, n, dpi, 1);
+            CHECK_EQUAL (B::opens, 1u);
+            CHECK_EQUAL (B::sysFontQueries + B::fontQueries, 2u);
+
+            cache.Invalidate ();
+            CHECK_EQUAL (B::closes, 1u);
+            CHECK_EQUAL (B::live, 0u);
+        }
+    }
+
+    void TestMixedDpi () {
+        Reset ();
+        ThemeCache cache;
+        const unsigned dpis [] = { 96, 120, 144, 192 };
+        Refresh (cache, 500, dpis, 4);
+
+        CHECK_EQUAL (B::opens, 4u);
+        CHECK_EQUAL (B::sysFontQueries, 4u);
+        CHECK_EQUAL (B::fontQueries, 4u);
+        CHECK_EQUAL (B::live, 4u);
+        CHECK_EQUAL (resources.Total ().other, 4u);
+
+        cache.Invalidate ();
+        CHECK_EQUAL (B::live, 0u);
+    }
+
+    void TestSettingsChange () {
+        Reset ();
+        ThemeCache cache;
+        const unsigned dpi [] = { 192 };
+        FakeFont font;
+        Refresh (cache, 500, dpi, 1, &font);
+        CHECK_EQUAL (font.lfHeight, -24);
+
+        // SPI_SETNONCLIENTMETRICS sends only WM_SETTINGCHANGE
+        B::sysFontHeight = -15;
+        cache.InvalidateSystemFonts ();
+        Refresh (cache, 500, dpi, 1, &font);
+
+        CHECK_EQUAL (font.lfHeight, -30);
+        CHECK_EQUAL (B::opens, 1u); // theme handle is kept
+        CHECK_EQUAL (B::sysFontQueries, 2u);
+        CHECK_EQUAL (B::fontQueries, 1u); // theme fonts are kept
+        cache.Invalidate ();
+    }
+
+    void TestUnthemed () {
+        Reset ();
+        B::themed = false;
+        ThemeCache cache;
+        const unsigned dpi [] = { 96 };
+        Refresh (cache, 100, dpi, 1);
+
+        // failures are memoized too, NULL handles are not accounted
+        CHECK_EQUAL (B::sysFontQueries, 1u);
+        CHECK_EQUAL (B::fontQueries, 1u);
+        CHECK_EQUAL (B::live, 0u);
+        cache.Invalidate ();
+        CHECK_EQUAL (B::closes, 0u);
+    }
+
+    void TestReplacement () {
+        Reset ();
+        ThemeCache cache;
+        FakeFont font;
+
+        // fill all 16 entries
+        for (auto dpi = 100u; dpi != 116u; ++dpi) {
+            cache.GetSysFont (nullptr, L"TEXTSTYLE", dpi, TMT_MSGBOXFONT, font);
+        }
+        CHECK_EQUAL (B::opens, 16u);
+        CHECK_EQUAL (B::closes, 0u);
+
+        // trimmed entries are reused, live ones are not closed
+        cache.Trim (5); // ticks 1..4, DPIs 100..103
+        CHECK_EQUAL (B::closes, 4u);
+        for (auto dpi = 200u; dpi != 204u; ++dpi) {
+            cache.GetSysFont (nullptr, L"TEXTSTYLE", dpi, TMT_MSGBOXFONT, font);
+        }
+        CHECK_EQUAL (B::opens, 20u);
+        CHECK_EQUAL (B::closes, 4u);
+        CHECK_EQUAL (B::live, 16u);
+
+        // with no free entry, the least recently used one is replaced: touch all but DPI 104
+        for (auto dpi = 105u; dpi != 116u; ++dpi) {
+            cache.GetSysFont (nullptr, L"TEXTSTYLE", dpi, TMT_MSGBOXFONT, font);
+        }
+        for (auto dpi = 200u; dpi != 204u; ++dpi) {
+            cache.GetSysFont (nullptr, L"TEXTSTYLE", dpi, TMT_MSGBOXFONT, font);
+        }
+        cache.GetSysFont (nullptr, L"TEXTSTYLE", 300, TMT_MSGBOXFONT, font);
+        CHECK_EQUAL (B::closes, 5u);
+
+        auto opens = B::opens;
+        cache.GetSysFont (nullptr, L"TEXTSTYLE", 105, TMT_MSGBOXFONT, font);
+        CHECK_EQUAL (B::opens, opens); // still there
+        cache.GetSysFont (nullptr, L"TEXTSTYLE", 104, TMT_MSGBOXFONT, font);
+        CHECK_EQUAL (B::opens, opens + 1); // was replaced
+
+        cache.Invalidate ();
+        CHECK_EQUAL (B::live, 0u);
+        CHECK_EQUAL (B::opens, B::closes);
+    }
+
+    void TestHardBudget () {
+        Reset ();
+        resources.hard.bytes = 3 * Resources::ThemeBytes;
+        ThemeCache cache;
+        FakeFont font;
+
+        // with no room in the budget, free entries are not taken, the least recently used one is replaced
+        for (auto dpi = 100u; dpi != 110u; ++dpi) {
+            cache.GetSysFont (nullptr, L"TEXTSTYLE", dpi, TMT_MSGBOXFONT, font);
+            CHECK (B::live <= 3u);
+        }
+        CHECK_EQUAL (B::live, 3u);
+        CHECK_EQUAL (B::opens, 10u);
+        CHECK_EQUAL (B::closes, 7u);
+
+        cache.Invalidate ();
+        CHECK_EQUAL (B::live, 0u);
+    }
+}
+
+int main () {
+    TestSameDpi ();
+    TestMixedDpi ();
+    TestSettingsChange ();
+    TestUnthemed ();
+    TestReplacement ();
+    TestHardBudget ();
+    return Failures ();
+}
@@ -0,0 +1,159 @@
+#include "fakes.hpp"
+
+#include <cstdio>
+#include <string>
+
+// update-test
+//  - counts message round-trips, style queries and repaints that BasicUpdate causes
+//    per refresh (BasicVisuals::Refresh) and per resize (BasicVisuals::Layout)
+//
+
+namespace {
+    using Update = BasicUpdate <FakeControlBackend>;
+    using B = FakeVisualsBackend;
+
+    const unsigned IDOK = B::OkButton;
+
+    void Reset () {
+        resources = Resources ();
+        cache.Close ();
+        theme.Invalidate ();
+        B::Reset ();
+        FakeThemeBackend::Reset ();
+    }
+
+    void Report (const char * what, const FakeWindow & window) {
+        std::printf ("%-28s %5u round-trips %5u queries %5u repaints\n", what, window.sends, window.queries, window.repaints);
+    }
+
+    void TestRefresh () {
+        Reset ();
+        FakeWindow window;
+        FakeVisuals visuals (&window, 96);
+
+        // first refresh applies everything, with single repaint
+        visuals.Refresh ();
+        Report ("first refresh", window);
+        CHECK_EQUAL (window.sends, 3u + 4u + 2u + 2u); // texts, fonts, icons, WM_SETREDRAW twice
+        CHECK_EQUAL (window.queries, 0u);
+        CHECK_EQUAL (window.repaints, 1u);
+        CHECK (window.controls [101].text.rfind (L"16 px text characters test: ", 0) == 0);
+        CHECK_EQUAL (window.controls [IDOK].font, visuals.fonts.text.handle);
+        CHECK_EQUAL (window.icons [B::BigIcon], visuals.icons.big.handle);
+        CHECK (window.redraw);
+
+        // nothing changed (e.g. WM_SETTINGCHANGE for unrelated setting), no control is asked anything
+        window.Reset ();
+        visuals.Refresh (true);
+        Report ("refresh, no change", window);
+        CHECK_EQUAL (window.sends, 2u);
+        CHECK_EQUAL (window.queries, 0u);
+        CHECK_EQUAL (window.repaints, 1u);
+
+        // new text font of the same height (e.g. the message box font made bold), same texts and icons
+        window.Reset ();
+        FakeThemeBackend::sysFontWeight = 700;
+        theme.InvalidateSystemFonts ();
+        visuals.Refresh (true);
+        Report ("refresh, new font", window);
+        CHECK_EQUAL (window.sends, 3u + 2u);
+        CHECK_EQUAL (window.queries, 0u);
+        CHECK_EQUAL (window.repaints, 1u);
+        CHECK_EQUAL (window.controls [102].font, visuals.fonts.text.handle);
+
+        // DPI change, everything but the scale factor text changes
+        window.Reset ();
+        visuals.dpi = 144;
+        visuals.Refresh ();
+        Report ("refresh, DPI change", window);
+        CHECK_EQUAL (window.sends, 2u + 4u + 2u + 2u);
+        CHECK_EQUAL (window.queries, 0u);
+        CHECK_EQUAL (window.repaints, 1u);
+        CHECK (window.controls [101].text.rfind (L"24 px text characters test: ", 0) == 0);
+    }
+
+    void TestResize () {
+        Reset ();
+        FakeWindow window;
+        FakeVisuals visuals (&window, 96);
+        visuals.Refresh ();
+        window.Reset ();
+
+        visuals.Layout (400, 300);
+        Report ("resize", window);
+        CHECK_EQUAL (window.sends, 1u); // single EndDeferWindowPos
+        CHECK_EQUAL (window.queries, 0u);
+        CHECK_EQUAL (window.repaints, 4u); // not suspended, controls repaint what they uncover
+        CHECK_EQUAL (window.controls [101].position.y, 150 - 25 / 2 - (16 + 2) - 4);
+    }
+
+    void TestHiddenParent () {
+        FakeWindow window;
+        Update::State state;
+        window.visible = false;
+
+        // control has WS_VISIBLE, even though IsWindowVisible would say false because of the parent
+        {
+            Update update ({ &window }, state);
+            update.Visibility (IDOK, true);
+            update.Commit ();
+        }
+        CHECK_EQUAL (window.sends, 0u);
+        CHECK_EQUAL (window.queries, 1u);
+
+        {
+            Update update ({ &window }, state);
+            update.Visibility (IDOK, false);
+            update.Text (100, L"hidden");
+            update.Commit ();
+        }
+        CHECK (!window.controls [IDOK].visible);
+        CHECK (window.controls [100].text == L"hidden");
+        CHECK_EQUAL (window.sends, 2u); // text and EndDeferWindowPos, no WM_SETREDRAW that would show the window
+        CHECK (window.redraw);
+    }
+
+    void TestCapacity () {
+        FakeWindow window;
+        Update::State state;
+        window.visible = false; // only the text changes are counted
+
+        // more changes than fit into one batch are committed in two, more controls
+        // than State tracks are always applied
+        for (auto round = 0; round != 2; ++round) {
+            window.Reset ();
+            Update update ({ &window }, state);
+            for (auto id = 1u; id != 21u; ++id) {
+                update.Text (id, L"text");
+            }
+            update.Commit ();
+            if (round == 0) {
+                CHECK_EQUAL (window.sends, 20u);
+            } else {
+                CHECK_EQUAL (window.sends, 12u);
+            }
+        }
+        for (auto id = 1u; id != 21u; ++id) {
+            CHECK (window.controls [id].text == L"text");
+        }
+
+        // long texts are truncated consistently, so they still compare equal
+        std::wstring text (100, L'x');
+        window.Reset ();
+        for (auto round = 0; round != 2; ++round) {
+            Update update ({ &window }, state);
+            update.Text (1, text.c_str ());
+            update.Commit ();
+        }
+        CHECK_EQUAL (window.sends, 1u);
+        CHECK_EQUAL (window.controls [1].text.size (), std::size_t (Update::TextLength - 1));
+    }
+}
+
+int main () {
+    TestRefresh ();
+    TestResize ();
+    TestHiddenParent ();
+    TestCapacity ();
+    return Failures ();
+}
@@ -0,0 +1,110 @@
+#include "fakes.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+
+// visual-cache-benchmark
+//  - cold start (no cache file: all metrics and theme fonts are queried and the file is written)
+//    versus warm start (file mapped, validated and records used in place), of one window's
+//    BasicVisuals::Refresh, as in WM_CREATE
+//  - platform calls are faked and counted, optional argument is simulated cost of one call in ns,
+//    by default they cost nothing, so the times show only the overhead of the cache itself and
+//    of the refresh work that doesn't depend on it (fonts, icons and controls)
+//
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const std::uint64_t Fingerprint = 0x5EED;
+
+    struct Counts {
+        unsigned calls = 0;
+        unsigned metricQueries = 0;
+        unsigned themeOpens = 0;
+    };
+
+    // Startup
+    //  - maps the file if present, refreshes window at 'dpi', which looks up (or discovers and stores)
+    //    the record, and writes the file if anything changed, adds platform calls made to 'counts'
+    //
+    void Startup (const char * path, long dpi, Counts & counts) {
+        resources = Resources ();
+        FakeGdi::Reset ();
+        FakeThemeBackend::Reset ();
+        FakeVisualsBackend::Reset ();
+
+        auto calls = platform.calls;
+        cache.Map (path, Fingerprint);
+        {
+            FakeWindow window;
+            FakeVisuals visuals (&window, dpi);
+            visuals.Refresh ();
+            platform.sink = visuals.metrics [FakeVisualsBackend::MetricsCount - 1];
+        }
+        cache.Flush (path);
+        counts.calls += platform.calls - calls;
+        counts.metricQueries += FakeVisualsBackend::metricQueries;
+        counts.themeOpens += FakeThemeBackend::opens;
+
+        // process exit
+        theme.Invalidate ();
+        cache.Close ();
+    }
+
+    double Microseconds (Clock::duration d) {
+        return std::chrono::duration <double, std::micro> (d).count ();
+    }
+}
+
+int main (int argc, char ** argv) {
+    if (argc > 1) {
+        platform.cost = std::atol (argv [1]);
+    }
+
+    char path [] = "/tmp/win32-dpi-cache-XXXXXX";
+    auto fd = mkstemp (path);
+    if (fd == -1)
+        return 1;
+    close (fd);
+
+    const int iterations = 2000;
+    const long dpis [] = { 96, 120, 144, 192 };
+
+    Clock::duration cold {};
+    Clock::duration warm {};
+    Counts coldCounts;
+    Counts warmCounts;
+
+    for (auto i = 0; i != iterations; ++i) {
+        unlink (path);
+
+        auto t0 = Clock::now ();
+        for (auto dpi : dpis) {
+            Startup (path, dpi, coldCounts);
+        }
+        auto t1 = Clock::now ();
+        for (auto dpi : dpis) {
+            Startup (path, dpi, warmCounts);
+        }
+        auto t2 = Clock::now ();
+
+        cold += t1 - t0;
+        warm += t2 - t1;
+    }
+    unlink (path);
+
+    const auto n = unsigned (iterations * int (sizeof dpis / sizeof dpis [0]));
+    const auto live = unsigned (sizeof FakeVisualsBackend::LiveMetrics / sizeof FakeVisualsBackend::LiveMetrics [0]);
+
+    std::printf ("visual cache startup, %u startups each, fake call cost %ld ns\n", n, platform.cost);
+    std::printf ("  cold: %8.2f us/startup, %6.2f platform calls/startup\n", Microseconds (cold) / n, double (coldCounts.calls) / n);
+    std::printf ("  warm: %8.2f us/startup, %6.2f platform calls/startup\n", Microseconds (warm) / n, double (warmCounts.calls) / n);
+
+    // warm start skips all but the live metrics, and the theme: open, scaling check, two font queries
+    CHECK_EQUAL (coldCounts.metricQueries, n * FakeVisualsBackend::MetricsCount);
+    CHECK_EQUAL (warmCounts.metricQueries, n * live);
+    CHECK_EQUAL (coldCounts.themeOpens, n);
+    CHECK_EQUAL (warmCounts.themeOpens, 0u);
+    CHECK_EQUAL (coldCounts.calls - warmCounts.calls, n * (FakeVisualsBackend::MetricsCount - live + 4));
+    return Failures ();
+}
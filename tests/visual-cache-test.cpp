@@ -0,0 +1,196 @@
+#include "win32-dpi-cache.hpp"
+#include "check.hpp"
+
+#include <cstring>
+#include <vector>
+
+// visual-cache-test
+//  - VisualCacheFormat validation of damaged, foreign and stale files
+//  - VisualCacheStore precedence of computed records over file records
+//
+
+namespace {
+    using Format = VisualCacheFormat;
+    using Status = VisualCacheFormat::Status;
+
+    const std::uint64_t fingerprint = 0x0123456789ABCDEFuLL;
+
+    Format::Record MakeRecord (std::int32_t dpi) {
+        Format::Record record = {};
+        record.dpi = dpi;
+        for (auto i = 0u; i != Format::MaxMetrics; ++i) {
+            record.metrics [i] = dpi * int (i);
+        }
+        record.text.height = -9 * dpi / 72;
+        record.title.height = -12 * dpi / 72;
+        record.title.weight = 700;
+        record.text.face [0] = 'S';
+        return record;
+    }
+
+    // File
+    //  - serialized content in 8-byte aligned storage, as mapped view would be
+    //
+    struct File {
+        std::vector <std::uint64_t> storage = std::vector <std::uint64_t> (Format::MaxFileSize / 8 + 1);
+        std::size_t size = 0;
+
+        unsigned char * data () { return reinterpret_cast <unsigned char *> (storage.data ()); }
+        Format::Header & header () { return *reinterpret_cast <Format::Header *> (storage.data ()); }
+
+        Status Validate (std::uint64_t fp = fingerprint) {
+            return Format::Validate (this->data (), this->size, fp);
+        }
+    };
+
+    File MakeFile (std::uint32_t count) {
+        std::vector <Format::Record> records;
+        for (auto i = 0u; i != count; ++i) {
+            records.push_back (MakeRecord (96 + 24 * std::int32_t (i)));
+        }
+        File file;
+        file.size = Format::Serialize (file.data (), fingerprint, records.data (), count);
+        return file;
+    }
+
+    void TestValid () {
+        auto file = MakeFile (3);
+        CHECK_EQUAL (file.size, sizeof (Format::Header) + 3 * sizeof (Format::Record));
+        CHECK (file.Validate () == Status::Valid);
+
+        auto empty = MakeFile (0);
+        CHECK (empty.Validate () == Status::Valid);
+
+        auto full = MakeFile (Format::MaxRecords);
+        CHECK (full.Validate () == Status::Valid);
+    }
+
+    void TestTruncated () {
+        auto file = MakeFile (3);
+        auto size = file.size;
+
+        for (auto cut : { std::size_t (0), std::size_t (1), sizeof (Format::Header) - 1,
+                          sizeof (Format::Header), size - sizeof (Format::Record), size - 1 }) {
+            file.size = cut;
+            CHECK (file.Validate () == Status::Truncated);
+        }
+        file.size = size + 1;
+        CHECK (file.Validate () == Status::Truncated);
+    }
+
+    void TestBadChecksum () {
+        auto file = MakeFile (3);
+        file.data () [sizeof (Format::Header) + sizeof (Format::Record) + 17] ^= 0x01; // metric of second record
+        CHECK (file.Validate () == Status::BadChecksum);
+
+        file = MakeFile (3);
+        file.header ().count = 2; // header fields are covered too
+        file.size -= sizeof (Format::Record);
+        CHECK (file.Validate () == Status::BadChecksum);
+
+        file = MakeFile (3);
+        file.header ().checksum ^= 1;
+        CHECK (file.Validate () == Status::BadChecksum);
+    }
+
+    void TestWrongVersion () {
+        auto file = MakeFile (2);
+        file.header ().version = Format::Version - 1;
+        CHECK (file.Validate () == Status::WrongVersion);
+
+        file.header ().version = Format::Version + 1;
+        CHECK (file.Validate () == Status::WrongVersion);
+    }
+
+    void TestWrongRecordSize () {
+        auto file = MakeFile (2);
+        file.header ().cbRecord = sizeof (Format::Record) - 4; // e.g. written with fewer metrics
+        CHECK (file.Validate () == Status::WrongRecordSize);
+    }
+
+    void TestStaleFingerprint () {
+        auto file = MakeFile (2);
+        CHECK (file.Validate (fingerprint + 1) == Status::StaleFingerprint);
+    }
+
+    void TestForeign () {
+        auto file = MakeFile (1);
+        file.header ().magic = 0x43445049; // other endianness
+        CHECK (file.Validate () == Status::BadMagic);
+
+        file = MakeFile (1);
+        file.header ().count = Format::MaxRecords + 1;
+        CHECK (file.Validate () == Status::TooManyRecords);
+    }
+
+    void TestStore () {
+        auto file = MakeFile (2); // 96 and 120
+        CHECK (file.Validate () == Status::Valid);
+
+        VisualCacheStore store;
+        store.Attach (file.data ());
+        CHECK (!store.IsDirty ());
+        CHECK (store.Find (96) != nullptr);
+        CHECK (store.Find (120) != nullptr);
+        CHECK (store.Find (144) == nullptr);
+        CHECK_EQUAL (store.Find (120)->metrics [10], 1200);
+
+        // records used in place
+        CHECK (reinterpret_cast <const unsigned char *> (store.Find (96)) == file.data () + sizeof (Format::Header));
+
+        // storing the same content doesn't make the store dirty
+        store.Store (MakeRecord (96));
+        CHECK (!store.IsDirty ());
+
+        // new content overrides the file record
+        auto changed = MakeRecord (96);
+        changed.metrics [5] = -1;
+        store.Store (changed);
+        CHECK (store.IsDirty ());
+        CHECK_EQUAL (store.Find (96)->metrics [5], -1);
+
+        store.Store (MakeRecord (144));
+
+        // serialized file contains merged records, pending ones take precedence
+        File written;
+        written.size = store.Serialize (written.data (), fingerprint);
+        CHECK (!store.IsAttached ());
+        CHECK (written.Validate () == Status::Valid);
+        CHECK_EQUAL (written.header ().count, 3u);
+
+        VisualCacheStore reloaded;
+        reloaded.Attach (written.data ());
+        CHECK_EQUAL (reloaded.Find (96)->metrics [5], -1);
+        CHECK (reloaded.Find (120) != nullptr);
+        CHECK (reloaded.Find (144) != nullptr);
+
+        // clearing (fingerprint change) forgets everything
+        reloaded.Clear ();
+        CHECK (reloaded.Find (96) == nullptr);
+    }
+
+    void TestCapacity () {
+        VisualCacheStore store;
+        for (auto i = 0u; i != Format::MaxRecords + 4; ++i) {
+            store.Store (MakeRecord (96 + std::int32_t (i)));
+        }
+        File file;
+        file.size = store.Serialize (file.data (), fingerprint);
+        CHECK (file.size <= Format::MaxFileSize);
+        CHECK (file.Validate () == Status::Valid);
+        CHECK_EQUAL (file.header ().count, Format::MaxRecords);
+    }
+}
+
+int main () {
+    TestValid ();
+    TestTruncated ();
+    TestBadChecksum ();
+    TestWrongVersion ();
+    TestWrongRecordSize ();
+    TestStaleFingerprint ();
+    TestForeign ();
+    TestStore ();
+    TestCapacity ();
+    return Failures ();
+}
@@ -0,0 +1,242 @@
+#ifndef WIN32_DPI_CACHE_HPP
+#define WIN32_DPI_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// VisualCacheFormat
+//  - layout, validation and serialization of the VisualCache file, see win32-dpi.cpp
+//  - platform-neutral, only fixed-width types, so that it can be built and tested anywhere
+//  - the file is written in native byte order, file from machine of other endianness fails the magic check
+//
+struct VisualCacheFormat {
+    static constexpr std::uint32_t Magic = 0x49504443; // "CDPI"
+    static constexpr std::uint32_t Version = 3;
+    static constexpr std::uint32_t MaxRecords = 16;
+    static constexpr std::uint32_t MaxMetrics = 100; // SM_CMETRICS is 97 in current SDKs, unused are zero
+
+    // Font
+    //  - LOGFONTW with fixed-width members
+    //
+    struct Font {
+        std::int32_t  height;
+        std::int32_t  width;
+        std::int32_t  escapement;
+        std::int32_t  orientation;
+        std::int32_t  weight;
+        std::uint8_t  italic;
+        std::uint8_t  underline;
+        std::uint8_t  strikeout;
+        std::uint8_t  charset;
+        std::uint8_t  precision;
+        std::uint8_t  clipping;
+        std::uint8_t  quality;
+        std::uint8_t  pitch;
+        std::uint16_t face [32];
+    };
+    struct Record {
+        std::int32_t dpi;
+        std::int32_t metrics [MaxMetrics];
+        Font         text;
+        Font         title;
+    };
+    struct Header {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t cbRecord;
+        std::uint32_t count;
+        std::uint64_t fingerprint;
+        std::uint64_t checksum; // FNV-1a of this header (with checksum = 0) and all records
+    };
+
+    static_assert (sizeof (Font) == 92, "Font must match LOGFONTW");
+    static_assert (sizeof (Record) == 4 + 4 * MaxMetrics + 2 * sizeof (Font), "Record must not be padded");
+    static_assert (sizeof (Header) == 32, "Header must not be padded");
+
+    static constexpr std::size_t MaxFileSize = sizeof (Header) + MaxRecords * sizeof (Record);
+
+    enum class Status {
+        Valid = 0,
+        Truncated,
+        BadMagic,
+        WrongVersion,
+        WrongRecordSize,
+        TooManyRecords,
+        StaleFingerprint,
+        BadChecksum,
+    };
+
+    static std::uint64_t Fnv1a (const void * data, std::size_t size, std::uint64_t hash = 0xCBF29CE484222325uLL) {
+        for (std::size_t i = 0; i != size; ++i) {
+            hash ^= static_cast <const unsigned char *> (data) [i];
+            hash *= 0x100000001B3uLL;
+        }
+        return hash;
+    }
+
+    static std::uint64_t Checksum (Header header, const Record * records) {
+        header.checksum = 0;
+        return Fnv1a (records, header.count * sizeof (Record), Fnv1a (&header, sizeof header));
+    }
+
+    // Validate
+    //  - anything unexpected (older version, truncated or damaged file, different system) is rejected
+    //  - 'data' must be at least 4-byte aligned, mapped views are
+    //
+    static Status Validate (const void * data, std::size_t size, std::uint64_t fingerprint) {
+        if (size < sizeof (Header))
+            return Status::Truncated;
+
+        const auto header = static_cast <const Header *> (data);
+        if (header->magic != Magic)
+            return Status::BadMagic;
+        if (header->version != Version)
+            return Status::WrongVersion;
+        if (header->cbRecord != sizeof (Record))
+            return Status::WrongRecordSize;
+        if (header->count > MaxRecords)
+            return Status::TooManyRecords;
+        if (size != sizeof (Header) + header->count * sizeof (Record))
+            return Status::Truncated;
+        if (header->fingerprint != fingerprint)
+            return Status::StaleFingerprint;
+        if (header->checksum != Checksum (*header, Records (data)))
+            return Status::BadChecksum;
+
+        return Status::Valid;
+    }
+
+    static const Record * Records (const void * data) {
+        return reinterpret_cast <const Record *> (static_cast <const Header *> (data) + 1);
+    }
+
+    // Serialize
+    //  - writes complete file content into 'buffer' of at least MaxFileSize bytes, returns its size
+    //
+    static std::size_t Serialize (void * buffer, std::uint64_t fingerprint, const Record * records, std::uint32_t count) {
+        if (count > MaxRecords) {
+            count = MaxRecords;
+        }
+        Header header = {
+            Magic, Version, sizeof (Record), count,
+            fingerprint, 0
+        };
+        header.checksum = Checksum (header, records);
+
+        std::memcpy (buffer, &header, sizeof header);
+        std::memcpy (static_cast <Header *> (buffer) + 1, records, count * sizeof (Record));
+        return sizeof header + count * sizeof (Record);
+    }
+};
+
+// VisualCacheStore
+//  - records of validated file content, used in place, and records computed by this process
+//  - the records computed by this process take precedence, those are what Serialize writes,
+//    together with file records that weren't replaced
+//
+class VisualCacheStore {
+public:
+    using Record = VisualCacheFormat::Record;
+
+private:
+    const void *  view = nullptr; // validated file content
+    Record        pending [VisualCacheFormat::MaxRecords];
+    std::uint32_t count = 0;
+    bool          dirty = false;
+
+public:
+
+    // Attach
+    //  - 'data' must have passed VisualCacheFormat::Validate and stay valid until Detach or Clear
+    //
+    void Attach (const void * data) {
+        this->view = data;
+    }
+
+    // Detach
+    //  - merges file records into the pending ones, so that the file can be unmapped
+    //
+    void Detach () {
+        if (this->view) {
+            auto header = static_cast <const VisualCacheFormat::Header *> (this->view);
+            auto records = VisualCacheFormat::Records (this->view);
+
+            for (auto i = 0u; (i != header->count) && (this->count != VisualCacheFormat::MaxRecords); ++i) {
+                if (!this->FindPending (records [i].dpi)) {
+                    this->pending [this->count++] = records [i];
+                }
+            }
+            this->view = nullptr;
+        }
+    }
+
+    // Clear
+    //  - forgets everything, file records and pending ones
+    //
+    void Clear () {
+        this->view = nullptr;
+        this->count = 0;
+        this->dirty = false;
+    }
+
+    bool IsAttached () const { return this->view != nullptr; }
+    bool IsDirty () const { return this->dirty; }
+
+    const Record * Find (std::int32_t dpi) const {
+        if (auto record = this->FindPending (dpi))
+            return record;
+
+        if (this->view) {
+            auto header = static_cast <const VisualCacheFormat::Header *> (this->view);
+            auto records = VisualCacheFormat::Records (this->view);
+
+            for (auto i = 0u; i != header->count; ++i) {
+                if (records [i].dpi == dpi)
+                    return &records [i];
+            }
+        }
+        return nullptr;
+    }
+
+    void Store (const Record & record) {
+        if (auto existing = this->Find (record.dpi)) {
+            if (std::memcmp (existing, &record, sizeof record) == 0)
+                return;
+        }
+        for (auto i = 0u; i != this->count; ++i) {
+            if (this->pending [i].dpi == record.dpi) {
+                this->pending [i] = record;
+                this->dirty = true;
+                return;
+            }
+        }
+        if (this->count != VisualCacheFormat::MaxRecords) {
+            this->pending [this->count++] = record;
+            this->dirty = true;
+        }
+    }
+
+    // Serialize
+    //  - detaches the view and writes everything into 'buffer' of at least MaxFileSize bytes
+    //  - call Written after the content was successfully stored
+    //
+    std::size_t Serialize (void * buffer, std::uint64_t fingerprint) {
+        this->Detach ();
+        return VisualCacheFormat::Serialize (buffer, fingerprint, this->pending, this->count);
+    }
+    void Written () {
+        this->dirty = false;
+    }
+
+private:
+    const Record * FindPending (std::int32_t dpi) const {
+        for (auto i = 0u; i != this->count; ++i) {
+            if (this->pending [i].dpi == dpi)
+                return &this->pending [i];
+        }
+        return nullptr;
+    }
+};
+
+#endif
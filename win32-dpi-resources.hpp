@@ -0,0 +1,457 @@
+#ifndef WIN32_DPI_RESOURCES_HPP
+#define WIN32_DPI_RESOURCES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Resources
+//  - central accounting of GDI and USER objects, and theme handles, held by the application,
+//    per type and per DPI; GDI and USER objects are separate pools with separate limits
+//  - icon is one USER object plus two GDI bitmaps (color and mask), font is one GDI object,
+//    theme handle is neither
+//  - byte sizes are only estimates, to tell small objects from large ones, actual kernel cost is unknown
+//  - caches stamp their entries with Tick () on use, so that unused ones can be trimmed in LRU order
+//    when over soft budget or under pressure, see Schedule and RunScheduled
+//  - 'pinned' objects (fonts, icons set on windows) are in use and can't be trimmed, trimming stops
+//    when only those would be left, see NeedsTrim
+//  - allocations are checked against hard budget by Admit, which first tries to trim synchronously
+//  - there is no destructor, the object lives for the lifetime of the process, OS cleans up
+//
+class Resources {
+public:
+    enum Type {
+        FontResource = 0,
+        IconResource,
+        ThemeResource,
+        BitmapResource,
+        ResourceTypesCount
+    };
+
+    struct Usage {
+        std::uint32_t gdi = 0;
+        std::uint32_t user = 0;
+        std::uint32_t other = 0; // theme handles
+        std::size_t   bytes = 0;
+
+        Usage & operator += (const Usage & usage) {
+            this->gdi += usage.gdi;
+            this->user += usage.user;
+            this->other += usage.other;
+            this->bytes += usage.bytes;
+            return *this;
+        }
+        Usage & operator -= (const Usage & usage) {
+            this->gdi = Subtract (this->gdi, usage.gdi);
+            this->user = Subtract (this->user, usage.user);
+            this->other = Subtract (this->other, usage.other);
+            this->bytes = Subtract (this->bytes, usage.bytes);
+            return *this;
+        }
+    };
+    struct Budget {
+        std::uint32_t gdi;
+        std::uint32_t user;
+        std::size_t   bytes;
+    };
+
+    // budgets, default per-process limit is 10000 GDI and 10000 USER objects
+
+    Budget soft = { 1000, 1000, 32 * 1024 * 1024 };
+    Budget hard = { 4000, 4000, 128 * 1024 * 1024 };
+
+    // hooks
+    //  - 'schedule' should arrange for RunScheduled to be called soon, but not right away (e.g. timer)
+    //  - 'trim' should release everything, in all caches, not used since 'before' tick
+    //
+    void (* schedule) () = nullptr;
+    void (* trim) (unsigned before) = nullptr;
+
+    // current usage, the last 'dpis' entry collects DPIs that didn't fit
+
+    Usage total [ResourceTypesCount];
+    Usage pinned;
+    struct PerDpi {
+        long  dpi = 0;
+        bool  assigned = false;
+        Usage usage [ResourceTypesCount];
+    } dpis [16];
+
+private:
+    unsigned clock = 0;
+    unsigned cutoff = 0; // Now () when trimming was scheduled
+    bool     scheduled = false;
+    bool     all = false;
+
+public:
+    static constexpr std::size_t FontBytes = 1024;
+    static constexpr std::size_t ThemeBytes = 256;
+
+    // IconBytes
+    //  - 32-bit color and 1-bit mask bitmaps, LoadBestIcon doesn't load icons larger than 256x256
+    //
+    static std::size_t IconBytes (long width, long height) {
+        std::size_t cx = (width > 256) ? 256 : (width > 0) ? width : 0;
+        std::size_t cy = (height > 256) ? 256 : (height > 0) ? height : 0;
+        return cx * cy * 4 + ((cx + 31) / 32) * 4 * cy;
+    }
+
+    // Cost
+    //  - objects and bytes one resource of 'type' takes
+    //
+    static Usage Cost (Type type, std::size_t bytes) {
+        Usage usage;
+        switch (type) {
+            case FontResource:
+            case BitmapResource:
+                usage.gdi = 1;
+                break;
+            case IconResource:
+                usage.user = 1;
+                usage.gdi = 2;
+                break;
+            case ThemeResource:
+            case ResourceTypesCount:
+                usage.other = 1;
+                break;
+        }
+        usage.bytes = bytes;
+        return usage;
+    }
+
+    unsigned Tick () {
+        return ++this->clock;
+    }
+    unsigned Now () const {
+        return this->clock;
+    }
+
+    void Add (Type type, long dpi, std::size_t bytes, bool pinned = false) {
+        auto cost = Cost (type, bytes);
+        this->Find (dpi).usage [type] += cost;
+        this->total [type] += cost;
+        if (pinned) {
+            this->pinned += cost;
+        }
+        if (this->NeedsTrim (this->soft)) {
+            this->Schedule (false);
+        }
+    }
+    void Remove (Type type, long dpi, std::size_t bytes, bool pinned = false) {
+        auto cost = Cost (type, bytes);
+        this->Find (dpi).usage [type] -= cost;
+        this->total [type] -= cost;
+        if (pinned) {
+            this->pinned -= cost;
+        }
+    }
+
+    Usage Total () const {
+        Usage sum;
+        for (const auto & usage : this->total) {
+            sum += usage;
+        }
+        return sum;
+    }
+    Usage Trimmable () const {
+        auto usage = this->Total ();
+        usage -= this->pinned;
+        return usage;
+    }
+
+    bool IsOverBudget (const Budget & budget) const {
+        return IsOver (this->Total (), budget);
+    }
+
+    // NeedsTrim
+    //  - over budget in GDI, USER or bytes, and there is something trimmable in that pool
+    //
+    bool NeedsTrim (const Budget & budget) const {
+        auto usage = this->Total ();
+        auto trimmable = this->Trimmable ();
+        return ((usage.gdi > budget.gdi) && trimmable.gdi)
+            || ((usage.user > budget.user) && trimmable.user)
+            || ((usage.bytes > budget.bytes) && trimmable.bytes);
+    }
+
+    // Fits
+    //  - whether new resource of 'type' can be allocated without getting over hard budget
+    //
+    bool Fits (Type type, std::size_t bytes) const {
+        auto usage = this->Total ();
+        usage += Cost (type, bytes);
+        return !IsOver (usage, this->hard);
+    }
+
+    // Admit
+    //  - like Fits, but if it doesn't fit, trims everything not used right now and tries again
+    //
+    bool Admit (Type type, std::size_t bytes) {
+        if (this->Fits (type, bytes))
+            return true;
+
+        if (this->trim) {
+            this->trim (this->Now () + 1);
+        }
+        return this->Fits (type, bytes);
+    }
+
+    // Schedule
+    //  - requests trimming, called by Add when over soft budget, the trimming is deferred
+    //    as the caller is likely just about to use the resource it has allocated
+    //  - 'all' for WM_COMPACTING, which every top-level window receives, but we trim only once
+    //
+    void Schedule (bool all) {
+        this->all |= all;
+        if (!this->scheduled && this->schedule) {
+            this->scheduled = true;
+            this->cutoff = this->Now ();
+            this->schedule ();
+        }
+    }
+
+    // RunScheduled
+    //  - trims least recently used first, until back under soft budget or only pinned objects are left
+    //  - entries used since the trimming was scheduled are kept, so the allocation that got us over
+    //    the budget isn't released before it's used
+    //  - with 'all' everything that will be reloaded when needed again is released
+    //  - the LRU order is approximated in quarters of the Tick () range
+    //
+    void RunScheduled () {
+        auto all = this->all;
+        this->scheduled = false;
+        this->all = false;
+
+        if (this->trim) {
+            if (all) {
+                this->trim (this->Now () + 1);
+            } else {
+                for (auto quarter = 1u; (quarter <= 4) && this->NeedsTrim (this->soft); ++quarter) {
+                    this->trim (unsigned (std::uint64_t (this->cutoff) * quarter / 4));
+                }
+            }
+        }
+    }
+
+private:
+    static bool IsOver (const Usage & usage, const Budget & budget) {
+        return (usage.gdi > budget.gdi) || (usage.user > budget.user) || (usage.bytes > budget.bytes);
+    }
+
+    template <typename T>
+    static T Subtract (T a, T b) {
+        return (a > b) ? (a - b) : 0;
+    }
+
+    // Find
+    //  - once assigned, the DPI entry is never reassigned, so that Add and Remove always agree
+    //
+    PerDpi & Find (long dpi) {
+        const auto n = sizeof this->dpis / sizeof this->dpis [0];
+        for (auto i = 0u; i != n - 1; ++i) {
+            if (this->dpis [i].assigned) {
+                if (this->dpis [i].dpi == dpi)
+                    return this->dpis [i];
+            } else {
+                this->dpis [i].dpi = dpi;
+                this->dpis [i].assigned = true;
+                return this->dpis [i];
+            }
+        }
+        return this->dpis [n - 1];
+    }
+};
+
+// BasicFont
+//  - somehow like this we need to store font handles to release on WM_THEMECHANGED or WM_DPICHANGED
+//  - and we need to remember pixel height to use when repositioning controls on window resize/restore
+//  - fonts are always pinned, they are in use by the controls
+//  - 'Backend' (see GdiBackend in win32-dpi.cpp) provides types Font (LOGFONT), FontHandle, IconHandle
+//    and Size, functions MakeFont, FreeFont, StockFont (Font &) also returning its LOGFONT, MakeIcon,
+//    FreeIcon, and Accountant () that returns the Resources instance
+//
+template <typename Backend>
+struct BasicFont {
+    using Handle = typename Backend::FontHandle;
+    using Font = typename Backend::Font;
+
+    Handle handle = Handle ();
+    long   height = 0;
+    long   dpi = 0; // DPI the font was created for, 0 for stock font
+    Font   lf = {}; // what 'handle' was created from (or stock font's), to keep it if nothing changed
+
+    BasicFont () = default;
+    BasicFont (const BasicFont &) = delete;
+    BasicFont & operator = (const BasicFont &) = delete;
+
+    ~BasicFont () {
+        this->release ();
+    }
+    void release () {
+        if ((this->handle != Handle ()) && (this->dpi != 0)) {
+            Backend::FreeFont (this->handle);
+            Backend::Accountant ().Remove (Resources::FontResource, this->dpi, Resources::FontBytes, true);
+        }
+        this->handle = Handle ();
+        this->dpi = 0;
+    }
+
+    // update
+    //  - if over hard budget, the current font, or stock one, is kept
+    //  - 'height' always describes the font in 'handle', not the requested one
+    //
+    bool update (const Font & lf, long dpi) {
+        if ((this->handle != Handle ()) && (this->dpi == dpi) && (std::memcmp (&this->lf, &lf, sizeof lf) == 0))
+            return true;
+
+        auto & resources = Backend::Accountant ();
+        if (resources.Admit (Resources::FontResource, Resources::FontBytes)) {
+            if (auto hNewFont = Backend::MakeFont (lf)) {
+                this->release ();
+                this->handle = hNewFont;
+                this->dpi = dpi;
+                this->lf = lf;
+                this->height = Height (lf);
+
+                resources.Add (Resources::FontResource, dpi, Resources::FontBytes, true);
+                return true;
+            }
+        }
+        if (this->handle == Handle ()) {
+            this->handle = Backend::StockFont (this->lf);
+            this->height = Height (this->lf);
+        }
+        return false;
+    }
+
+private:
+    static long Height (const Font & lf) {
+        if (lf.lfHeight > 0) {
+            return lf.lfHeight;
+        } else
+            return 96 * -lf.lfHeight / 72;
+    }
+};
+
+// BasicIcon
+//  - like BasicFont, owns the handle and remembers what's needed to account for it in Resources
+//  - 'pinned' icons are those set on the window, never trimmed
+//
+template <typename Backend>
+struct BasicIcon {
+    using Handle = typename Backend::IconHandle;
+    using Size = typename Backend::Size;
+
+    Handle   handle = Handle ();
+    Size     size = { 0, 0 };
+    long     dpi = 0;
+    unsigned used = 0; // Resources::Tick () of last use
+    bool     pinned = false;
+
+    BasicIcon () = default;
+    BasicIcon (const BasicIcon &) = delete;
+    BasicIcon & operator = (const BasicIcon &) = delete;
+
+    ~BasicIcon () {
+        this->release ();
+    }
+
+    // load
+    //  - fails if the icon can't be loaded or if it doesn't fit into hard budget
+    //
+    bool load (Size size, long dpi, bool pinned = false) {
+        auto & resources = Backend::Accountant ();
+        auto bytes = Resources::IconBytes (size.cx, size.cy);
+
+        if (resources.Admit (Resources::IconResource, bytes)) {
+            if (auto hNewIcon = Backend::MakeIcon (size)) {
+                this->release ();
+                this->handle = hNewIcon;
+                this->size = size;
+                this->dpi = dpi;
+                this->pinned = pinned;
+                this->used = resources.Tick ();
+
+                resources.Add (Resources::IconResource, dpi, bytes, pinned);
+                return true;
+            }
+        }
+        return false;
+    }
+    void touch () {
+        this->used = Backend::Accountant ().Tick ();
+    }
+    void release () {
+        if (this->handle != Handle ()) {
+            Backend::FreeIcon (this->handle);
+            Backend::Accountant ().Remove (Resources::IconResource, this->dpi,
+                                           Resources::IconBytes (this->size.cx, this->size.cy), this->pinned);
+            this->handle = Handle ();
+        }
+    }
+};
+
+// BasicIconCache
+//  - small cache for icons of other DPIs than the window is on, requested by taskbars on other displays
+//
+template <typename Backend, unsigned N = 16>
+struct BasicIconCache {
+    struct Entry {
+        unsigned           type = 0;
+        BasicIcon <Backend> icon;
+    } entries [N];
+
+    struct Found {
+        bool    found;
+        Entry * entry;
+    };
+
+    // Find
+    //  - if not found, returns free entry, or least recently used one if there's none
+    //    or if another icon wouldn't fit into hard budget
+    //
+    Found Find (unsigned type, long dpi, std::size_t bytes) {
+        Entry * empty = nullptr;
+        Entry * oldest = nullptr;
+
+        for (auto & entry : this->entries) {
+            if (entry.icon.handle != typename Backend::IconHandle ()) {
+                if ((entry.type == type) && (entry.icon.dpi == dpi))
+                    return { true, &entry };
+
+                if (!oldest || (entry.icon.used < oldest->icon.used)) {
+                    oldest = &entry;
+                }
+            } else {
+                if (!empty) {
+                    empty = &entry;
+                }
+            }
+        }
+        if (empty && !(oldest && !Backend::Accountant ().Fits (Resources::IconResource, bytes)))
+            return { false, empty };
+        else
+            return { false, oldest };
+    }
+
+    // Trim
+    //  - releases icons not used since 'before' tick
+    //
+    void Trim (unsigned before) {
+        for (auto & entry : this->entries) {
+            if ((entry.icon.handle != typename Backend::IconHandle ()) && (entry.icon.used < before)) {
+                entry.icon.release ();
+                entry.type = 0;
+            }
+        }
+    }
+
+    void Clear () {
+        for (auto & entry : this->entries) {
+            entry.icon.release ();
+            entry.type = 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef WIN32_DPI_STARTUP_HPP
+#define WIN32_DPI_STARTUP_HPP
+
+#include <cstdint>
+#include <cwchar>
+#include <cwctype>
+
+// HasArgument
+//  - whether 'cmdline' contains 'argument' as a whole argument, so "-tracer" or "x-trace" don't match
+//  - arguments are separated by whitespace, quotes around an argument are ignored, escapes are not supported
+//
+inline bool HasArgument (const wchar_t * cmdline, const wchar_t * argument) {
+    if (!cmdline)
+        return false;
+
+    auto length = std::wcslen (argument);
+    while (*cmdline) {
+        while (std::iswspace (*cmdline)) {
+            ++cmdline;
+        }
+        auto quoted = (*cmdline == L'"');
+        if (quoted) {
+            ++cmdline;
+        }
+        auto begin = cmdline;
+        while (*cmdline && (quoted ? (*cmdline != L'"') : !std::iswspace (*cmdline))) {
+            ++cmdline;
+        }
+        if ((std::size_t (cmdline - begin) == length) && (std::wcsncmp (begin, argument, length) == 0))
+            return true;
+
+        if (quoted && *cmdline) {
+            ++cmdline;
+        }
+    }
+    return false;
+}
+
+// BasicStartupTrace
+//  - when started with "-trace" argument, prints milestones of the startup, with time since
+//    Initialize and since previous milestone, so that cost of each step can be read directly
+//  - milestones are also kept, for Elapsed, so that benchmarks can read them too
+//  - 'Backend' (see TraceBackend in win32-dpi.cpp) provides Frequency (std::int64_t &) returning
+//    success, Now () in ticks of that frequency, and Output (text)
+//
+template <typename Backend>
+class BasicStartupTrace {
+    std::int64_t frequency = 0;
+    std::int64_t start = 0;
+
+    struct Milestone {
+        const wchar_t * event;
+        std::int64_t    time;
+    } milestones [32];
+    unsigned count = 0;
+
+public:
+    bool enabled = false;
+
+    void Initialize (const wchar_t * cmdline) {
+        this->Enable (HasArgument (cmdline, L"-trace"));
+    }
+    void Enable (bool enable) {
+        this->count = 0;
+        this->enabled = enable && Backend::Frequency (this->frequency) && (this->frequency > 0);
+        if (this->enabled) {
+            this->start = Backend::Now ();
+        }
+    }
+
+    void Event (const wchar_t * event) {
+        if (this->enabled) {
+            auto now = Backend::Now ();
+            auto previous = this->count ? this->milestones [this->count - 1].time : this->start;
+
+            if (this->count != sizeof this->milestones / sizeof this->milestones [0]) {
+                this->milestones [this->count++] = { event, now };
+            }
+
+            wchar_t text [128];
+            std::swprintf (text, 128, L"win32-dpi: %8.3f ms (+%7.3f ms) %ls\n",
+                           this->Milliseconds (now - this->start), this->Milliseconds (now - previous), event);
+            Backend::Output (text);
+        }
+    }
+
+    // Elapsed
+    //  - milliseconds from Initialize to the first milestone named 'event', or -1 if there was none
+    //
+    double Elapsed (const wchar_t * event) const {
+        for (auto i = 0u; i != this->count; ++i) {
+            if (std::wcscmp (this->milestones [i].event, event) == 0)
+                return this->Milliseconds (this->milestones [i].time - this->start);
+        }
+        return -1.0;
+    }
+
+private:
+    double Milliseconds (std::int64_t ticks) const {
+        return 1000.0 * double (ticks) / double (this->frequency);
+    }
+};
+
+// BasicStartup
+//  - order of the startup work, so that the first frame waits only for what it needs
+//  - Run does what's needed before the first frame: OS symbols, mapping VisualCache (so that the
+//    window is created from cached records), and the current text scale factor; opening the
+//    registry key and registering for its change notification (RegNotifyChangeKeyValue) is part
+//    of that, as the notification must not miss a change made after the factor was read
+//  - Idle runs on the first idle message loop iteration, after the first frame is painted:
+//    waiting for that notification (RegisterWaitForSingleObject) and writing VisualCache file
+//  - milestones go to the startup trace, see BasicStartupTrace
+//  - 'Backend' (see StartupBackend in win32-dpi.cpp) provides Event (name), LoadSymbols (),
+//    MapVisualCache (), ReadTextScale (), CreateMainWindow () and ShowMainWindow (), returning success
+//    where it makes sense, ScheduleIdle () that arranges for Idle to be called, and WatchTextScale ()
+//    and FlushVisualCache () called from it
+//
+template <typename Backend>
+class BasicStartup {
+    Backend backend;
+
+public:
+    explicit BasicStartup (Backend backend)
+        : backend (backend) {};
+
+    // Run
+    //  - returns false if the window couldn't be created
+    //
+    bool Run () {
+        this->backend.Event (L"wWinMain");
+
+        this->backend.LoadSymbols ();
+        this->backend.Event (L"symbols");
+
+        this->backend.Event (this->backend.MapVisualCache () ? L"visual cache mapped" : L"visual cache not available");
+
+        this->backend.ReadTextScale ();
+        this->backend.Event (L"text scale");
+
+        if (!this->backend.CreateMainWindow ())
+            return false;
+
+        this->backend.ShowMainWindow ();
+        this->backend.Event (L"ShowWindow");
+
+        this->backend.ScheduleIdle ();
+        return true;
+    }
+
+    // Idle
+    //  - non-essential startup work, deferred until after the first frame
+    //
+    void Idle () {
+        this->backend.Event (L"first idle");
+        this->backend.WatchTextScale ();
+        this->backend.FlushVisualCache ();
+        this->backend.Event (L"deferred work done");
+    }
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef WIN32_DPI_THEME_HPP
+#define WIN32_DPI_THEME_HPP
+
+#include <cwchar>
+
+// BasicThemeCache
+//  - theme handles per class list and DPI, shared by all windows, dropped only on WM_THEMECHANGED
+//  - resolved fonts are memoized already normalized to the target DPI, so refreshing N windows
+//    at the same DPI doesn't open the theme, query it, or check AreDpiApisScaled, N times
+//  - system fonts (GetThemeSysFont) come from system settings, not the theme, so those are dropped
+//    on WM_SETTINGCHANGE, see InvalidateSystemFonts
+//  - we assume all windows have the same DPI awareness, so AreDpiApisScaled is evaluated only
+//    for the first window that asks for particular class list and DPI
+//  - under resource pressure the entries can be trimmed, they are reopened when needed again
+//  - 'Backend' makes the actual calls (see ThemeBackend in win32-dpi.cpp), it provides:
+//     - types Window, Handle and Font
+//     - IsScaled (Window), Open (Window, classes, dpi, scaled), Close (Handle)
+//     - GetSysFont (Handle, id, Font &), GetFont (Handle, part, state, id, Font &), both return success
+//     - Scale (Font &, dpi) to scale from system DPI to 'dpi'
+//     - Tick () for LRU stamps, Opened (dpi) and Closed (dpi) for accounting of non-NULL handles
+//     - CanGrow (), false when another handle wouldn't fit into hard budget
+//
+template <typename Backend>
+class BasicThemeCache {
+    using Window = typename Backend::Window;
+    using Handle = typename Backend::Handle;
+    using Font = typename Backend::Font;
+
+    static constexpr int SysFont = -1; // 'part' of properties retrieved through GetSysFont
+
+    struct Property {
+        int  part;
+        int  state;
+        int  id;
+        bool ok;
+        Font font;
+    };
+    struct Entry {
+        const wchar_t * classes = nullptr;
+        unsigned        dpi = 0;
+        Handle          handle = Handle (); // can be NULL, see Window::ResolveFonts
+        bool            scaled = false; // GetTheme... APIs already return values for 'dpi'
+        unsigned        used = 0; // Backend::Tick () of last use
+        Property        properties [4];
+        unsigned        count = 0;
+    } entries [16];
+
+public:
+    bool GetSysFont (Window window, const wchar_t * classes, unsigned dpi, int id, Font & font) {
+        return this->Resolve (this->Find (window, classes, dpi), SysFont, 0, id, font);
+    }
+    bool GetFont (Window window, const wchar_t * classes, unsigned dpi, int part, int state, int id, Font & font) {
+        return this->Resolve (this->Find (window, classes, dpi), part, state, id, font);
+    }
+
+    void Invalidate () {
+        for (auto & entry : this->entries) {
+            this->Close (entry);
+        }
+    }
+
+    // InvalidateSystemFonts
+    //  - forgets memoized system fonts, theme handles and theme fonts are kept
+    //
+    void InvalidateSystemFonts () {
+        for (auto & entry : this->entries) {
+            auto n = 0u;
+            for (auto i = 0u; i != entry.count; ++i) {
+                if (entry.properties [i].part != SysFont) {
+                    entry.properties [n++] = entry.properties [i];
+                }
+            }
+            entry.count = n;
+        }
+    }
+
+    // Trim
+    //  - closes entries not used since 'before' tick
+    //
+    void Trim (unsigned before) {
+        for (auto & entry : this->entries) {
+            if (entry.classes && (entry.used < before)) {
+                this->Close (entry);
+            }
+        }
+    }
+
+private:
+
+    // Find
+    //  - if not found, takes free entry, or replaces the least recently used one if there's none
+    //    or if another handle can't be opened within hard budget
+    //
+    Entry & Find (Window window, const wchar_t * classes, unsigned dpi) {
+        Entry * free = nullptr;
+        Entry * oldest = nullptr;
+
+        for (auto & entry : this->entries) {
+            if (entry.classes) {
+                if ((entry.dpi == dpi) && (std::wcscmp (entry.classes, classes) == 0)) {
+                    entry.used = Backend::Tick ();
+                    return entry;
+                }
+                if (!oldest || (entry.used < oldest->used)) {
+                    oldest = &entry;
+                }
+            } else {
+                if (!free) {
+                    free = &entry;
+                }
+            }
+        }
+
+        auto & entry = (free && !(oldest && !Backend::CanGrow ())) ? *free : *oldest;
+        this->Close (entry);
+
+        entry.classes = classes;
+        entry.dpi = dpi;
+        entry.scaled = Backend::IsScaled (window);
+        entry.used = Backend::Tick ();
+        entry.handle = Backend::Open (window, classes, dpi, entry.scaled);
+
+        if (entry.handle) {
+            Backend::Opened (dpi);
+        }
+        return entry;
+    }
+
+    void Close (Entry & entry) {
+        if (entry.handle) {
+            Backend::Close (entry.handle);
+            Backend::Closed (entry.dpi);
+        }
+        entry.classes = nullptr;
+        entry.dpi = 0;
+        entry.handle = Handle ();
+        entry.count = 0;
+    }
+
+    // Resolve
+    //  - NOTE: GetThemeFont is affected by v2 scaling, GetThemeSysFont is not (see AreDpiApisScaled)
+    //
+    bool Resolve (Entry & entry, int part, int state, int id, Font & font) {
+        for (auto i = 0u; i != entry.count; ++i) {
+            const auto & property = entry.properties [i];
+            if ((property.part == part) && (property.state == state) && (property.id == id)) {
+                font = property.font;
+                return property.ok;
+            }
+        }
+
+        Property property = { part, state, id, false, Font () };
+        if (part == SysFont) {
+            property.ok = Backend::GetSysFont (entry.handle, id, property.font);
+            if (property.ok) {
+                Backend::Scale (property.font, entry.dpi);
+            }
+        } else {
+            property.ok = Backend::GetFont (entry.handle, part, state, id, property.font);
+            if (property.ok && !entry.scaled) {
+                Backend::Scale (property.font, entry.dpi);
+            }
+        }
+
+        if (entry.count != sizeof entry.properties / sizeof entry.properties [0]) {
+            entry.properties [entry.count++] = property;
+        }
+        font = property.font;
+        return property.ok;
+    }
+};
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef WIN32_DPI_UPDATE_HPP
+#define WIN32_DPI_UPDATE_HPP
+
+#include <cwchar>
+
+// BasicUpdate
+//  - batches text, font, icon, position and visibility changes of child controls (and window icons)
+//    so that a refresh doesn't cost a synchronous message round-trip and a repaint for every change
+//  - changes that wouldn't change anything are dropped without asking the controls: texts, fonts
+//    and icons are compared with what was last applied (kept in State, owned by the window),
+//    visibility with WS_VISIBLE style of the control
+//  - redraw of the window is suspended while applying, everything is then invalidated once,
+//    but not if the window is hidden, as WM_SETREDRAW (TRUE) would show it
+//  - 'Backend' makes the actual calls (see UpdateBackend in win32-dpi.cpp), it provides:
+//     - types Handle (font or icon), Point and Size
+//     - IsVisible (), IsControlVisible (id), SetRedraw (bool), Redraw ()
+//     - SetText (id, text), SetFont (id, Handle), SetIcon (type, Handle)
+//     - BeginDefer (n), DeferPosition (id, Point, Size, redraw), DeferVisibility (id, visible, redraw), EndDefer ()
+//
+template <typename Backend>
+class BasicUpdate {
+public:
+    using Handle = typename Backend::Handle;
+    using Point = typename Backend::Point;
+    using Size = typename Backend::Size;
+
+    static constexpr unsigned TextLength = 64;
+
+    // State
+    //  - what was last applied to the controls, controls must be changed only through BasicUpdate
+    //
+    class State {
+        friend class BasicUpdate;
+
+        struct Control {
+            unsigned id = 0;
+            bool     text = false; // 'text' below is valid
+            bool     font = false; // 'handle' below is valid
+            wchar_t  caption [TextLength] = {};
+            Handle   handle = Handle ();
+        } controls [8];
+
+        struct {
+            unsigned type = 0;
+            bool     set = false;
+            Handle   handle = Handle ();
+        } icons [3]; // ICON_SMALL, ICON_BIG, ICON_SMALL2
+
+        Control * Find (unsigned id) {
+            for (auto & control : this->controls) {
+                if (control.id == id)
+                    return &control;
+            }
+            for (auto & control : this->controls) {
+                if (control.id == 0) {
+                    control.id = id;
+                    return &control;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+private:
+    enum Kind {
+        TextChange,
+        FontChange,
+        IconChange,
+        PositionChange,
+        VisibilityChange,
+    };
+    struct Change {
+        Kind     kind;
+        unsigned id; // control ID, or ICON_xxx for IconChange
+        Handle   handle;
+        Point    position;
+        Size     size;
+        bool     visible;
+        wchar_t  text [TextLength];
+    } changes [16];
+
+    Backend    backend;
+    State &    state;
+    unsigned   count = 0;
+    bool       redraw = false;
+
+public:
+    BasicUpdate (Backend backend, State & state)
+        : backend (backend)
+        , state (state) {};
+
+    void Text (unsigned id, const wchar_t * text) {
+        auto & change = this->Add (TextChange, id);
+        auto i = 0u;
+        for (; text [i] && (i != TextLength - 1); ++i) {
+            change.text [i] = text [i];
+        }
+        change.text [i] = L'\0';
+    }
+    void Font (unsigned id, Handle font) {
+        this->Add (FontChange, id).handle = font;
+    }
+    void Icon (unsigned type, Handle icon) {
+        this->Add (IconChange, type).handle = icon;
+    }
+    void Position (unsigned id, const Point & position, const Size & size) {
+        auto & change = this->Add (PositionChange, id);
+        change.position = position;
+        change.size = size;
+    }
+    void Visibility (unsigned id, bool visible) {
+        this->Add (VisibilityChange, id).visible = visible;
+    }
+
+    // Redraw
+    //  - requests the whole window to be invalidated on Commit, even if nothing else changes
+    //
+    void Redraw () {
+        this->redraw = true;
+    }
+
+    void Commit () {
+        auto n = 0u;
+        auto deferred = 0u;
+        auto visual = false;
+
+        for (auto i = 0u; i != this->count; ++i) {
+            if (!this->IsNoOp (this->changes [i])) {
+                switch (this->changes [i].kind) {
+                    case PositionChange:
+                    case VisibilityChange:
+                        ++deferred;
+                        break;
+                    default:
+                        visual = true;
+                }
+                this->changes [n++] = this->changes [i];
+            }
+        }
+        this->count = 0;
+
+        auto suspend = (visual || this->redraw) && this->backend.IsVisible ();
+        if (suspend) {
+            this->backend.SetRedraw (false);
+        }
+        if (deferred) {
+            this->backend.BeginDefer (deferred);
+        }
+
+        for (auto i = 0u; i != n; ++i) {
+            const auto & change = this->changes [i];
+            switch (change.kind) {
+                case TextChange:
+                    this->backend.SetText (change.id, change.text);
+                    this->Applied (change);
+                    break;
+                case FontChange:
+                    this->backend.SetFont (change.id, change.handle);
+                    this->Applied (change);
+                    break;
+                case IconChange:
+                    this->backend.SetIcon (change.id, change.handle);
+                    this->Applied (change);
+                    break;
+                case PositionChange:
+                    this->backend.DeferPosition (change.id, change.position, change.size, !suspend);
+                    break;
+                case VisibilityChange:
+                    this->backend.DeferVisibility (change.id, change.visible, !suspend);
+                    break;
+            }
+        }
+        if (deferred) {
+            this->backend.EndDefer ();
+        }
+
+        if (suspend) {
+            this->backend.SetRedraw (true);
+            this->backend.Redraw ();
+        }
+        this->redraw = false;
+    }
+
+private:
+    Change & Add (Kind kind, unsigned id) {
+        if (this->count == sizeof this->changes / sizeof this->changes [0]) {
+            this->Commit ();
+        }
+        auto & change = this->changes [this->count++];
+        change.kind = kind;
+        change.id = id;
+        return change;
+    }
+
+    bool IsNoOp (const Change & change) {
+        switch (change.kind) {
+            case TextChange:
+                if (auto control = this->state.Find (change.id))
+                    return control->text && std::wcscmp (control->caption, change.text) == 0;
+                break;
+            case FontChange:
+                if (auto control = this->state.Find (change.id))
+                    return control->font && (control->handle == change.handle);
+                break;
+            case IconChange:
+                for (const auto & icon : this->state.icons) {
+                    if (icon.set && (icon.type == change.id))
+                        return icon.handle == change.handle;
+                }
+                break;
+            case VisibilityChange:
+                return this->backend.IsControlVisible (change.id) == change.visible;
+            default:
+                break;
+        }
+        return false;
+    }
+
+    void Applied (const Change & change) {
+        switch (change.kind) {
+            case TextChange:
+                if (auto control = this->state.Find (change.id)) {
+                    std::wcscpy (control->caption, change.text);
+                    control->text = true;
+                }
+                break;
+            case FontChange:
+                if (auto control = this->state.Find (change.id)) {
+                    control->handle = change.handle;
+                    control->font = true;
+                }
+                break;
+            case IconChange:
+                for (auto & icon : this->state.icons) {
+                    if (!icon.set || (icon.type == change.id)) {
+                        icon.type = change.id;
+                        icon.handle = change.handle;
+                        icon.set = true;
+                        break;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef WIN32_DPI_VISUALS_HPP
+#define WIN32_DPI_VISUALS_HPP
+
+#include <cwchar>
+
+#include "win32-dpi-cache.hpp"
+#include "win32-dpi-resources.hpp"
+#include "win32-dpi-update.hpp"
+
+// BasicVisuals
+//  - everything of the window that depends on DPI, theme and system settings: metrics, fonts,
+//    icons, and what was last applied to the child controls
+//  - Refresh retrieves all of it for current DPI and applies it to the controls, Layout positions
+//    the controls, GetIcon answers WM_GETICON, see Window in win32-dpi.cpp
+//  - first refresh at given DPI uses VisualCache record if there is one, refresh after settings
+//    change retrieves everything anew and replaces the record
+//  - 'Backend' (see VisualsBackend in win32-dpi.cpp) provides:
+//     - types Window, Font, Gdi (backend of BasicFont and BasicIcon) and Controls (backend of BasicUpdate,
+//       constructed from { Window })
+//     - MetricsCount, LiveMetrics (never used from VisualCache), and metrics indices CxIcon, CyIcon,
+//       CxSmallIcon, CySmallIcon and CyBorder
+//     - icon types SmallIcon, BigIcon and SmallIcon2 (ICON_xxx), and OkButton (IDOK)
+//     - SystemDpi (), Metric (index, dpi, dpiSystem) and IsWindows10 ()
+//     - Find (dpi) and Store (record) of the VisualCache, and Pack (Font) and Unpack (font) of its fonts
+//     - TextFont (Window, dpi, Font &) and TitleFont (Window, dpi, Font &) from the theme, both return success,
+//       DefaultFont (Font &) at system DPI, returning success, Scale (Font &, dpi, dpiSystem), Bold (Font &)
+//     - ApplyTextScale (Font &) and TextScaleFactor () in percent
+//
+template <typename Backend>
+struct BasicVisuals {
+    using Window = typename Backend::Window;
+    using Font = typename Backend::Font;
+    using Gdi = typename Backend::Gdi;
+    using Size = typename Gdi::Size;
+    using Icon = BasicIcon <Gdi>;
+    using IconHandle = typename Gdi::IconHandle;
+    using Update = BasicUpdate <typename Backend::Controls>;
+
+    enum IconSize {
+        SmallIconSize = 0,
+        StartIconSize,
+        LargeIconSize,
+    };
+
+    const Window window;
+    long dpi = 96;
+    int  metrics [Backend::MetricsCount] = { 0 };
+    long metricsDpi = 0; // DPI for which 'metrics' were retrieved
+
+    struct {
+        BasicFont <Gdi> text;
+        BasicFont <Gdi> title;
+    } fonts;
+
+    struct {
+        Icon small; // ICON_SMALL and ICON_SMALL2
+        Icon big; // ICON_BIG, see MapIconSize
+        BasicIconCache <Gdi> dpi_cache; // icons of different DPI
+    } icons;
+
+    typename Update::State applied; // what was last applied to child controls and window icons, see BasicUpdate
+
+    BasicVisuals (Window window, long dpi)
+        : window (window)
+        , dpi (dpi) {};
+
+    // GetIconMetrics
+    //  - we want crisp icons wherever possible
+    //
+    Size GetIconMetrics (IconSize size) const {
+        switch (size) {
+            case SmallIconSize:
+                return { this->metrics [Backend::CxSmallIcon], this->metrics [Backend::CySmallIcon] };
+            case StartIconSize:
+                return {
+                    (this->metrics [Backend::CxIcon] + this->metrics [Backend::CxSmallIcon]) / 2,
+                    (this->metrics [Backend::CyIcon] + this->metrics [Backend::CySmallIcon]) / 2
+                };
+            case LargeIconSize:
+            default:
+                return { this->metrics [Backend::CxIcon], this->metrics [Backend::CyIcon] };
+        }
+    }
+
+    // MapIconSize
+    //  - selecting proper IconSize from WM_GETICON/WM_SETICON wParam
+    //  - using proper size for Windows 10 taskbar
+    //
+    static IconSize MapIconSize (unsigned type) {
+        switch (type) {
+            case Backend::BigIcon:
+
+                // Windows 10 Taskbar icons are not 32x32, but 24x24 (on 96 DPI)
+                //  - note that using 24x24 for ICON_BIG works only if the application isn't pinned,
+                //    then the Shell will load 32x32 and scale it down despite 24x24 being available;
+                //    and surprisingly pinning it explicitly with 24x24 icon won't work either, such
+                //    icon will be scaled up to 32x32 and then down to 24x24 resulting in blurry mess
+
+                if (Backend::IsWindows10 ()) {
+                    return StartIconSize;
+                } else {
+                    return LargeIconSize;
+                }
+            case Backend::SmallIcon:
+            case Backend::SmallIcon2:
+                return SmallIconSize;
+            default:
+                return LargeIconSize;
+        }
+    }
+
+    // RefreshMetrics
+    //  - enables us to use 'this->metrics [SM_xxx]' whenever we need some metrics
+    //    instead of calling the function at every spot
+    //  - some values are not actually metrics (exercise for the reader)
+    //  - does nothing if metrics for current DPI are already present (e.g. from WM_NCCREATE),
+    //    clear 'metricsDpi' to force the refresh when system settings change
+    //  - 'cache' is false when refreshing after settings change, VisualCache can't tell
+    //    all the settings the metrics depend on
+    //  - work area and session state metrics are always queried, see Backend::LiveMetrics
+    //
+    void RefreshMetrics (unsigned dpiSystem = Backend::SystemDpi (), bool cache = true) {
+        static_assert (Backend::MetricsCount <= VisualCacheFormat::MaxMetrics);
+
+        if (this->metricsDpi == this->dpi)
+            return;
+
+        if (auto cached = cache ? Backend::Find (this->dpi) : nullptr) {
+            for (auto i = 0; i != Backend::MetricsCount; ++i) {
+                this->metrics [i] = cached->metrics [i];
+            }
+            for (auto i : Backend::LiveMetrics) {
+                this->metrics [i] = Backend::Metric (i, this->dpi, dpiSystem);
+            }
+        } else {
+            for (auto i = 0; i != Backend::MetricsCount; ++i) {
+                this->metrics [i] = Backend::Metric (i, this->dpi, dpiSystem);
+            }
+        }
+        this->metricsDpi = this->dpi;
+    }
+
+    // ResolveFonts
+    //  - retrieves text and title fonts for current DPI, but without text scale applied
+    //  - note that theme can be unavailable when XP,Vista,7 is in classic mode
+    //    or when compatibility mode is imposed onto the window
+    //
+    void ResolveFonts (unsigned dpiSystem, Font & text, Font & title) {
+        if (!Backend::TextFont (this->window, this->dpi, text)) {
+            if (Backend::DefaultFont (text)) {
+                Backend::Scale (text, this->dpi, dpiSystem);
+            }
+        }
+        if (!Backend::TitleFont (this->window, this->dpi, title)) {
+            // themes off or unavailable, reuse above one and make it bold
+            title = text;
+            Backend::Bold (title);
+        }
+    }
+
+    // Refresh
+    //  - retrieves fonts, metrics and icons for current DPI and applies them to the controls
+    //  - 'settings' is true when refreshing after system settings change, in that case everything
+    //    is retrieved anew, and VisualCache record updated, see RefreshMetrics
+    //
+    void Refresh (bool settings = false) {
+        if (settings) {
+            this->metricsDpi = 0;
+        }
+
+        auto dpiSystem = Backend::SystemDpi ();
+        auto cached = settings ? nullptr : Backend::Find (this->dpi);
+
+        Font lfText = {};
+        Font lfTitle = {};
+
+        if (cached) {
+            lfText = Backend::Unpack (cached->text);
+            lfTitle = Backend::Unpack (cached->title);
+        } else {
+            this->ResolveFonts (dpiSystem, lfText, lfTitle);
+        }
+
+        Font lf;
+
+        lf = lfText;
+        Backend::ApplyTextScale (lf);
+        this->fonts.text.update (lf, this->dpi);
+
+        lf = lfTitle;
+        Backend::ApplyTextScale (lf);
+        this->fonts.title.update (lf, this->dpi);
+
+        Update update ({ this->window }, this->applied);
+        update.Redraw ();
+
+        // display text size
+
+        wchar_t text [64];
+        std::swprintf (text, 64, L"%ld px TITLE", this->fonts.title.height);
+        update.Text (100, text);
+
+        std::swprintf (text, 64, L"%ld px text characters test: \x158\xB3 \x338 \x2211 \xBEB\xA675:", this->fonts.text.height);
+        update.Text (101, text);
+
+        std::swprintf (text, 64, L"Text scale factor: %lu", (unsigned long) Backend::TextScaleFactor ());
+        update.Text (102, text);
+
+        // set the new font(s) to appropriate children
+
+        update.Font (100, this->fonts.title.handle);
+        update.Font (101, this->fonts.text.handle);
+        update.Font (102, this->fonts.text.handle);
+        update.Font (Backend::OkButton, this->fonts.text.handle);
+
+        // refresh everthing else
+
+        this->RefreshMetrics (dpiSystem, !settings);
+
+        if (!cached) {
+            VisualCacheFormat::Record record = {};
+            record.dpi = this->dpi;
+            for (auto i = 0; i != Backend::MetricsCount; ++i) {
+                record.metrics [i] = this->metrics [i];
+            }
+            record.text = Backend::Pack (lfText);
+            record.title = Backend::Pack (lfTitle);
+            Backend::Store (record);
+        }
+
+        // DPI changes also size of window icons
+
+        auto reload = [this] (Icon & icon, IconSize type) {
+            auto size = this->GetIconMetrics (type);
+            if (!icon.handle || (icon.dpi != this->dpi) || (icon.size.cx != size.cx) || (icon.size.cy != size.cy)) {
+                icon.load (size, this->dpi, true);
+            }
+        };
+        reload (this->icons.small, MapIconSize (Backend::SmallIcon));
+        reload (this->icons.big, MapIconSize (Backend::BigIcon));
+
+        // drop DPI-specific icon cache
+
+        this->icons.dpi_cache.Clear ();
+
+        // set primary pair of icons for the window
+
+        update.Icon (Backend::SmallIcon, this->icons.small.handle);
+        update.Icon (Backend::BigIcon, this->icons.big.handle);
+
+        update.Commit ();
+    }
+
+    // Layout
+    //  - positions the controls in client area of 'width' and 'height'
+    //
+    void Layout (long width, long height) {
+        using Point = typename Update::Point;
+        using Extent = typename Update::Size;
+
+        Update update ({ this->window }, this->applied);
+        Point center = { width / 2, height / 2 };
+        auto scale = long (Backend::TextScaleFactor ());
+
+        // use a little larger than recommended size from uxguide: https://docs.microsoft.com/en-us/windows/win32/uxguide/ctrl-command-buttons
+        Extent sizeButton = {
+            (85 * this->dpi * scale) / (96 * 100),
+            (25 * this->dpi * scale) / (96 * 100)
+        };
+        // center it
+        Point posButton = {
+            center.x - sizeButton.cx / 2,
+            center.y - sizeButton.cy / 2,
+        };
+
+        update.Position (Backend::OkButton, posButton, sizeButton);
+
+        // make the label height fit the font tightly + the border
+        Extent sizeLabel = {
+            width,
+            this->fonts.text.height + 2 * this->metrics [Backend::CyBorder]
+        };
+        Point posLabel = {
+            0,
+            posButton.y - sizeLabel.cy - (4 * this->dpi / 96) // uxguide says 4px spacing
+        };
+        update.Position (101, posLabel, sizeLabel);
+
+        Extent sizeLabel2 = {
+            width,
+            this->fonts.text.height + 2 * this->metrics [Backend::CyBorder]
+        };
+        Point posLabel2 = {
+            0,
+            posButton.y + sizeButton.cy + (4 * this->dpi / 96)
+        };
+        update.Position (102, posLabel2, sizeLabel2);
+
+        // title
+        Extent sizeTitle = {
+            width / 3,
+            this->fonts.title.height
+        };
+        Point posTitle = {
+            width / 3,
+            posLabel.y - sizeTitle.cy - (7 * this->dpi / 96)
+        };
+        update.Position (100, posTitle, sizeTitle);
+
+        update.Commit ();
+    }
+
+    // GetIcon
+    //  - WM_GETICON, 'ndpi' is its lParam
+    //  - OS (taskbars on different displays) or other app may ask for icon in different DPI, those are
+    //    kept in 'dpi_cache'; otherwise only ICON_SMALL2 needs answer, the rest is set on the window
+    //  - returns no icon if default handling should be used
+    //
+    IconHandle GetIcon (unsigned type, long ndpi) {
+        if (ndpi && (ndpi != this->dpi)) {
+            auto size = this->GetIconMetrics (MapIconSize (type));
+            size = { ndpi * size.cx / 96, ndpi * size.cy / 96 };
+
+            auto [found, data] = this->icons.dpi_cache.Find (type, ndpi, Resources::IconBytes (size.cx, size.cy));
+            if (found) {
+                data->icon.touch ();
+            } else {
+                data->icon.release ();
+                data->type = type;
+                data->icon.load (size, ndpi);
+            }
+            return data->icon.handle;
+
+        } else
+        if (type == Backend::SmallIcon2)
+            return this->icons.small.handle;
+        else
+            return IconHandle ();
+    }
+
+    // Trim
+    //  - releases icons for other DPIs that weren't used since 'before' tick
+    //  - fonts and the pair of icons set on the window (pinned) are in use, those are never trimmed
+    //
+    void Trim (unsigned before) {
+        this->icons.dpi_cache.Trim (before);
+    }
+};
+
+#endif
@@ -7,10 +7,18 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <cwchar>
 #include <new>
 
+#include "win32-dpi-cache.hpp"
+#include "win32-dpi-resources.hpp"
+#include "win32-dpi-startup.hpp"
+#include "win32-dpi-theme.hpp"
+#include "win32-dpi-update.hpp"
+#include "win32-dpi-visuals.hpp"
+
 extern "C" IMAGE_DOS_HEADER __ImageBase;
-extern "C" const IID IID_IImageList;
 
 // APIs we need, but are not available in all supported OS'
 //  - if support for pre-1607 releases of Windows 10 is not required, the code can be a lot simpler
@@ -23,6 +31,8 @@ UINT (WINAPI * pfnGetDpiForWindow) (HWND) = NULL;
 BOOL (WINAPI * ptrAreDpiAwarenessContextsEqual) (DPI_AWARENESS_CONTEXT, DPI_AWARENESS_CONTEXT) = NULL;
 DPI_AWARENESS_CONTEXT (WINAPI * ptrGetWindowDpiAwarenessContext) (HWND) = NULL;
 HRESULT (WINAPI * ptrLoadIconWithScaleDown) (HINSTANCE, PCWSTR, int, int, HICON *) = NULL;
+LONG (WINAPI * ptrRtlGetVersion) (RTL_OSVERSIONINFOW *) = NULL;
+HTHEME (WINAPI * ptrOpenThemeDataForDpi) (HWND, LPCWSTR, UINT) = NULL;
 
 // Convenient loading function, see WinMain
 //  - simplified version of https://github.com/tringi/emphasize/blob/master/Windows/Windows_Symbol.hpp
@@ -156,6 +166,32 @@ private:
 
 } TextScale;
 
+// TraceBackend
+//  - timing and output for StartupTrace, see win32-dpi-startup.hpp
+//  - when started with "-trace", milestones are printed into debugger output (use DebugView or debugger
+//    to see them), the first frame is painted before the "first idle" milestone, see wWinMain
+//
+struct TraceBackend {
+    static bool Frequency (std::int64_t & frequency) {
+        LARGE_INTEGER f;
+        if (!QueryPerformanceFrequency (&f))
+            return false;
+
+        frequency = f.QuadPart;
+        return true;
+    }
+    static std::int64_t Now () {
+        LARGE_INTEGER t;
+        QueryPerformanceCounter (&t);
+        return t.QuadPart;
+    }
+    static void Output (const wchar_t * text) {
+        OutputDebugString (text);
+    }
+};
+
+BasicStartupTrace <TraceBackend> StartupTrace;
+
 // Most (hopefully) reliable way to detect if v2 scaling is imposed on the window
 //  - uxtheme Get... APIs return per-window scaled values only if this yields true, otherwise do: dpi * value / dpiSystem
 //  - NOTE: GetThemeFont is affected, GetThemeSysFont is not (and still needs to be adjusted)
@@ -167,15 +203,60 @@ bool AreDpiApisScaled (HWND hWnd) {
         return false;
 }
 
-enum IconSize {
-    SmallIconSize = 0,
-    StartIconSize,
-    LargeIconSize,
-    ShellIconSize,
-    JumboIconSize,
-    IconSizesCount
+// Resources
+//  - there is no destructor, the object lives for the lifetime of the process, OS cleans up
+//
+Resources Resources;
+
+// ThemeBackend
+//  - uxtheme calls made by ThemeCache, see win32-dpi-theme.hpp
+//
+struct ThemeBackend {
+    using Window = HWND;
+    using Handle = HTHEME;
+    using Font = LOGFONT;
+
+    static bool IsScaled (HWND hWnd) {
+        return AreDpiApisScaled (hWnd);
+    }
+    static HTHEME Open (HWND hWnd, LPCWSTR classes, UINT dpi, bool scaled) {
+        if (scaled && ptrOpenThemeDataForDpi) {
+            return ptrOpenThemeDataForDpi (hWnd, classes, dpi);
+        } else
+            return OpenThemeData (hWnd, classes);
+    }
+    static void Close (HTHEME hTheme) {
+        CloseThemeData (hTheme);
+    }
+    static bool GetSysFont (HTHEME hTheme, int id, LOGFONT & lf) {
+        return GetThemeSysFont (hTheme, id, &lf) == S_OK;
+    }
+    static bool GetFont (HTHEME hTheme, int part, int state, int id, LOGFONT & lf) {
+        return GetThemeFont (hTheme, NULL, part, state, id, &lf) == S_OK;
+    }
+    static void Scale (LOGFONT & lf, UINT dpi) {
+        lf.lfHeight = MulDiv (lf.lfHeight, dpi, GetDPI (NULL));
+    }
+
+    static UINT Tick () {
+        return Resources.Tick ();
+    }
+    static bool CanGrow () {
+        return Resources.Fits (Resources::ThemeResource, Resources::ThemeBytes);
+    }
+    static void Opened (UINT dpi) {
+        Resources.Add (Resources::ThemeResource, dpi, Resources::ThemeBytes);
+    }
+    static void Closed (UINT dpi) {
+        Resources.Remove (Resources::ThemeResource, dpi, Resources::ThemeBytes);
+    }
 };
 
+// ThemeCache
+//  - there is no destructor, the object lives for the lifetime of the process, OS cleans up
+//
+BasicThemeCache <ThemeBackend> ThemeCache;
+
 HICON LoadBestIcon (HMODULE hModule, LPCWSTR resource, SIZE size) {
     HICON hNewIcon = NULL;
     if (size.cx > 256) size.cx = 256;
@@ -192,184 +273,415 @@ HICON LoadBestIcon (HMODULE hModule, LPCWSTR resource, SIZE size) {
         return (HICON) LoadImage (hModule, resource, IMAGE_ICON, size.cx, size.cy, LR_DEFAULTCOLOR);
 }
 
-struct Window {
-    const HWND hWnd;
-private:
-    long dpi = 96;
-    int  metrics [SM_CMETRICS] = { 0 };
-    HCURSOR cursor = NULL;
+// GdiBackend
+//  - GDI and USER calls made by Window's fonts, icons and the icon cache, see win32-dpi-resources.hpp
+//
+struct GdiBackend {
+    using Font = LOGFONT;
+    using FontHandle = HFONT;
+    using IconHandle = HICON;
+    using Size = SIZE;
+
+    static HFONT MakeFont (const LOGFONT & lf) {
+        return CreateFontIndirect (&lf);
+    }
+    static void FreeFont (HFONT hFont) {
+        DeleteObject (hFont);
+    }
+    static HFONT StockFont (LOGFONT & lf) {
+        auto hFont = (HFONT) GetStockObject (DEFAULT_GUI_FONT);
+        if (!GetObject (hFont, sizeof lf, &lf)) {
+            lf = {};
+        }
+        return hFont;
+    }
+    static HICON MakeIcon (SIZE size) {
+        return LoadBestIcon (reinterpret_cast <HINSTANCE> (&__ImageBase), MAKEINTRESOURCE (1), size);
+    }
+    static void FreeIcon (HICON hIcon) {
+        DestroyIcon (hIcon);
+    }
+    static class Resources & Accountant () {
+        return Resources;
+    }
+};
 
-    struct {
-        HICON standard [IconSizesCount] = { NULL };
+// UpdateBackend
+//  - Win32 calls made by Window's BasicUpdate, see win32-dpi-update.hpp
+//
+struct UpdateBackend {
+    using Handle = HANDLE;
+    using Point = POINT;
+    using Size = SIZE;
 
-        // small cache for icons of different DPI
+    HWND hWnd;
+    HDWP hDwp = NULL;
 
-        struct PerDpiIcon {
-            WPARAM type = 0;
-            LPARAM dpi = 0;
-            HICON  icon = NULL;
-        } dpi_cache [16];
+    bool IsVisible () const {
+        return IsWindowVisible (this->hWnd);
+    }
+    bool IsControlVisible (UINT id) const {
+        return GetWindowLong (GetDlgItem (this->hWnd, id), GWL_STYLE) & WS_VISIBLE; // IsWindowVisible would also check parents
+    }
+    void SetRedraw (bool redraw) {
+        SendMessage (this->hWnd, WM_SETREDRAW, redraw, 0);
+    }
+    void Redraw () {
+        RedrawWindow (this->hWnd, NULL, NULL, RDW_ERASE | RDW_FRAME | RDW_INVALIDATE | RDW_ALLCHILDREN);
+    }
+    void SetText (UINT id, const wchar_t * text) {
+        SetDlgItemText (this->hWnd, id, text);
+    }
+    void SetFont (UINT id, HANDLE font) {
+        SendDlgItemMessage (this->hWnd, id, WM_SETFONT, (WPARAM) font, FALSE);
+    }
+    void SetIcon (UINT type, HANDLE icon) {
+        SendMessage (this->hWnd, WM_SETICON, type, (LPARAM) icon);
+    }
+    void BeginDefer (UINT n) {
+        this->hDwp = BeginDeferWindowPos (n);
+    }
+    void DeferPosition (UINT id, const POINT & position, const SIZE & size, bool redraw) {
+        if (this->hDwp) {
+            this->hDwp = DeferWindowPos (this->hDwp, GetDlgItem (this->hWnd, id), NULL,
+                                         position.x, position.y, size.cx, size.cy, Flags (redraw));
+        }
+    }
+    void DeferVisibility (UINT id, bool visible, bool redraw) {
+        if (this->hDwp) {
+            this->hDwp = DeferWindowPos (this->hDwp, GetDlgItem (this->hWnd, id), NULL, 0, 0, 0, 0,
+                                         Flags (redraw) | SWP_NOMOVE | SWP_NOSIZE | (visible ? SWP_SHOWWINDOW : SWP_HIDEWINDOW));
+        }
+    }
+    void EndDefer () {
+        if (this->hDwp) {
+            EndDeferWindowPos (this->hDwp);
+            this->hDwp = NULL;
+        }
+    }
+    static UINT Flags (bool redraw) {
+        return SWP_NOACTIVATE | SWP_NOZORDER | (redraw ? 0 : SWP_NOREDRAW);
+    }
+};
 
-        struct {
-            bool         found;
-            PerDpiIcon * icon;
+// VisualCache
+//  - optional on-disk cache of per-DPI visual state, so that warm start can skip ~100 metric queries
+//    and theme font lookups for every DPI it has already seen
+//  - the file is memory-mapped read-only and records are used in place, there is no parsing,
+//    layout and validation is in win32-dpi-cache.hpp
+//  - fingerprint covers what the cached values depend on; on mismatch the file is ignored and new one
+//    is written (to temporary file which is then moved over the old one) when the process exits
+//  - metrics that depend on work area (taskbar size, position, auto-hide) or session state are not
+//    fingerprinted, those are always queried, see LiveMetrics
+//  - used only for first refresh at given DPI, refresh after settings change re-queries everything
+//    and stores the result, see BasicVisuals::Refresh
+//  - fonts are stored before TextScale.Apply, so the text scale factor doesn't need to be fingerprinted
+//  - there is no destructor, the object lives for the lifetime of the process, OS cleans up
+//
+class VisualCache {
+    wchar_t          path [MAX_PATH] = { 0 };
+    std::uint64_t    fingerprint = 0;
+    HANDLE           hMapping = NULL;
+    const void *     view = NULL;
+    VisualCacheStore store;
 
-        } find_in_dpi_cache (WPARAM type, LPARAM dpi) {
-            for (auto & icon : this->dpi_cache) {
-                if ((icon.type == type) && (icon.dpi == dpi))
-                    return { true, &icon };
+public:
+    using Record = VisualCacheFormat::Record;
 
-                if (icon.dpi == 0)
-                    return { false, &icon };
-            }
-            return { false, nullptr };
+    // LiveMetrics
+    //  - metrics that are stored, but never used from the file, see BasicVisuals::RefreshMetrics
+    //
+    static constexpr int LiveMetrics [] = {
+        SM_CXFULLSCREEN, SM_CYFULLSCREEN, SM_CXMAXIMIZED, SM_CYMAXIMIZED, SM_CLEANBOOT, SM_NETWORK
+    };
+
+    bool Initialize () {
+        wchar_t directory [MAX_PATH];
+        auto n = GetEnvironmentVariable (L"LOCALAPPDATA", directory, MAX_PATH);
+        if (n == 0 || n >= MAX_PATH) {
+            n = GetTempPath (MAX_PATH, directory);
+            if (n == 0 || n >= MAX_PATH)
+                return false;
+        }
+        if (directory [n - 1] == L'\\') {
+            directory [n - 1] = L'\0';
         }
-    } icons;
+        if (swprintf (this->path, MAX_PATH, L"%ls\\win32-dpi.cache", directory) < 0) {
+            this->path [0] = L'\0';
+            return false;
+        }
+        StartupTrace.Event (L"visual cache path");
 
-    explicit Window (HWND hWnd)
-        : hWnd (hWnd)
-        , dpi (GetDPI (hWnd)) {};
+        // fingerprint queries theme name, settings and OS version, paid on every start, warm or cold
 
-    // GetIconMetrics
-    //  - we want crisp icons wherever possible
-    //  - including the larger sizes is just flexing
-    //
-    SIZE GetIconMetrics (IconSize size, UINT dpiSystem = 0) {
-        switch (size) {
-            case SmallIconSize:
-                return { metrics [SM_CXSMICON], metrics [SM_CYSMICON] };
-            case StartIconSize:
-                return {
-                    (metrics [SM_CXICON] + metrics [SM_CXSMICON]) / 2,
-                    (metrics [SM_CYICON] + metrics [SM_CYSMICON]) / 2
-                };
-            case LargeIconSize:
-            default:
-                return { metrics [SM_CXICON], metrics [SM_CYICON] };
-
-            case ShellIconSize:
-            case JumboIconSize:
-                if (dpiSystem == 0) {
-                    dpiSystem = GetDPI (NULL);
-                }
-                if (IsWindowsVistaOrGreater () || (size == ShellIconSize)) { // XP doesn't have Jumbo
-                    if (HMODULE hShell32 = GetModuleHandle (L"SHELL32")) {
-                        HRESULT (WINAPI * ptrSHGetImageList) (int, const GUID &, void **) = NULL;
-
-                        if (IsWindowsVistaOrGreater ()) {
-                            Symbol (hShell32, ptrSHGetImageList, "SHGetImageList");
-                        } else {
-                            Symbol (hShell32, ptrSHGetImageList, 727);
-                        }
-                        if (ptrSHGetImageList) {
-                            HIMAGELIST list;
-                            if (ptrSHGetImageList ((size == JumboIconSize) ? SHIL_JUMBO : SHIL_EXTRALARGE,
-                                                   IID_IImageList, (void **) &list) == S_OK) {
-                                int cx, cy;
-                                if (ImageList_GetIconSize (list, &cx, &cy)) {
-                                    switch (size) {
-                                        case ShellIconSize: return { long (cx * this->dpi / dpiSystem), long (cy * this->dpi / dpiSystem) };
-                                        case JumboIconSize: return { long (cx * this->dpi / 96), long (cy * this->dpi / 96) };
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-                switch (size) {
-                    default:
-                    case ShellIconSize: return { long (48 * this->dpi / dpiSystem), long (48 * this->dpi / dpiSystem) };
-                    case JumboIconSize: return { long (256 * this->dpi / 96), long (256 * this->dpi / 96) };
-                }
-        }
+        this->fingerprint = this->Fingerprint ();
+        StartupTrace.Event (L"visual cache fingerprint");
+        return this->Map ();
     }
 
-    // MapIconSize
-    //  - selecting proper IconSize from WM_GETICON/WM_SETICON wParam
-    //  - using proper size for Windows 10 taskbar
+    // Validate
+    //  - should be called when system settings, theme or display configuration might have changed
+    //  - drops everything cached (mapped or pending) if the fingerprint no longer matches
     //
-    IconSize MapIconSize (WPARAM type) {
-        switch (type) {
-            case ICON_BIG:
-
-                // Windows 10 Taskbar icons are not 32x32, but 24x24 (on 96 DPI)
-                //  - note that using 24x24 for ICON_BIG works only if the application isn't pinned,
-                //    then the Shell will load 32x32 and scale it down despite 24x24 being available;
-                //    and surprisingly pinning it explicitly with 24x24 icon won't work either, such
-                //    icon will be scaled up to 32x32 and then down to 24x24 resulting in blurry mess
-
-                if (IsWindows10OrGreater ()) {
-                    return StartIconSize;
-                } else {
-                    return LargeIconSize;
-                }
-            case ICON_SMALL:
-            case ICON_SMALL2:
-                return SmallIconSize;
-            default:
-                return LargeIconSize;
+    void Validate () {
+        auto updated = this->Fingerprint ();
+        if (this->fingerprint != updated) {
+            this->fingerprint = updated;
+            this->store.Clear ();
+            this->Unmap ();
         }
     }
 
-    // RefreshVisualMetrics
-    //  - enables us to use 'this->metrics [SM_xxx]' whenever we need some metrics
-    //    instead of calling the function at every spot
-    //  - some values are not actually metrics (exercise for the reader)
+    const Record * Find (long dpi) const {
+        return this->store.Find (dpi);
+    }
+    void Store (const Record & record) {
+        this->store.Store (record);
+    }
+
+    // Flush
+    //  - writes mapped records, that were not replaced, together with the new ones into a new file
+    //  - if other instance has the file mapped the replace may fail, we'll try again next time
     //
-    LRESULT RefreshVisualMetrics (UINT dpiSystem = GetDPI (NULL)) {
-        if (ptrGetSystemMetricsForDpi) {
-            for (auto i = 0; i != sizeof metrics / sizeof metrics [0]; ++i) {
-                this->metrics [i] = ptrGetSystemMetricsForDpi (i, this->dpi);
-            }
-        } else {
-            for (auto i = 0; i != sizeof metrics / sizeof metrics [0]; ++i) {
-                this->metrics [i] = this->dpi * GetSystemMetrics (i) / dpiSystem;
+    void Flush () {
+        if (!this->store.IsDirty () || !this->path [0])
+            return;
+
+        static unsigned char buffer [VisualCacheFormat::MaxFileSize];
+        auto cb = DWORD (this->store.Serialize (buffer, this->fingerprint));
+        this->Unmap ();
+
+        wchar_t temporary [MAX_PATH + 16];
+        swprintf (temporary, MAX_PATH + 16, L"%ls.%lu", this->path, GetCurrentProcessId ());
+
+        auto h = CreateFile (temporary, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h != INVALID_HANDLE_VALUE) {
+            DWORD n;
+            auto written = WriteFile (h, buffer, cb, &n, NULL) && (n == cb);
+            CloseHandle (h);
+
+            if (written && MoveFileEx (temporary, this->path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+                this->store.Written ();
+            } else {
+                DeleteFile (temporary);
             }
         }
-        return 0;
     }
 
-    // Font
-    //  - somehow like this we need to store font handles to release on WM_THEMECHANGED or WM_DPICHANGED
-    //  - and we need to remember pixel height to use when repositioning controls on window resize/restore
+    // Pack/Unpack
+    //  - conversion between LOGFONT and its fixed-width copy in the file
     //
-    struct Font {
-        HFONT handle = NULL;
-        long  height = 0;
+    static VisualCacheFormat::Font Pack (const LOGFONT & lf) {
+        VisualCacheFormat::Font font = {
+            lf.lfHeight, lf.lfWidth, lf.lfEscapement, lf.lfOrientation, lf.lfWeight,
+            lf.lfItalic, lf.lfUnderline, lf.lfStrikeOut, lf.lfCharSet,
+            lf.lfOutPrecision, lf.lfClipPrecision, lf.lfQuality, lf.lfPitchAndFamily, {}
+        };
+        for (auto i = 0u; i != LF_FACESIZE; ++i) {
+            font.face [i] = lf.lfFaceName [i];
+        }
+        return font;
+    }
+    static LOGFONT Unpack (const VisualCacheFormat::Font & font) {
+        LOGFONT lf = {
+            font.height, font.width, font.escapement, font.orientation, font.weight,
+            font.italic, font.underline, font.strikeout, font.charset,
+            font.precision, font.clipping, font.quality, font.pitch, {}
+        };
+        for (auto i = 0u; i != LF_FACESIZE; ++i) {
+            lf.lfFaceName [i] = wchar_t (font.face [i]);
+        }
+        return lf;
+    }
 
-        ~Font () {
-            if (this->handle != NULL) {
-                DeleteObject (this->handle);
-            }
+private:
+    bool Map () {
+        LARGE_INTEGER size;
+        auto h = CreateFile (this->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h == INVALID_HANDLE_VALUE)
+            return false;
+
+        if (GetFileSizeEx (h, &size) && (size.QuadPart > 0) && (size.QuadPart <= (LONGLONG) VisualCacheFormat::MaxFileSize)) {
+            this->hMapping = CreateFileMapping (h, NULL, PAGE_READONLY, 0, 0, NULL);
         }
-        bool update (LOGFONT lf) {
-            if (lf.lfHeight > 0) {
-                this->height = lf.lfHeight;
-            } else {
-                this->height = 96 * -lf.lfHeight / 72;
-            }
-            if (auto hNewFont = CreateFontIndirect (&lf)) {
-                if (this->handle != NULL) {
-                    DeleteObject (this->handle);
-                }
-                this->handle = hNewFont;
-                return true;
-            } else {
-                if (this->handle == NULL) {
-                    this->handle = (HFONT) GetStockObject (DEFAULT_GUI_FONT);
+        CloseHandle (h);
+
+        if (this->hMapping) {
+            if (auto p = MapViewOfFile (this->hMapping, FILE_MAP_READ, 0, 0, 0)) {
+                if (VisualCacheFormat::Validate (p, std::size_t (size.QuadPart), this->fingerprint) == VisualCacheFormat::Status::Valid) {
+                    this->view = p;
+                    this->store.Attach (p);
+                    return true;
                 }
-                return false;
+                UnmapViewOfFile (p);
             }
+            CloseHandle (this->hMapping);
+            this->hMapping = NULL;
         }
-    };
+        return false;
+    }
 
-    struct {
-        Font text;
-        Font title;
-    } fonts;
+    void Unmap () {
+        this->store.Detach ();
+        if (this->view) {
+            UnmapViewOfFile (this->view);
+            this->view = NULL;
+        }
+        if (this->hMapping) {
+            CloseHandle (this->hMapping);
+            this->hMapping = NULL;
+        }
+    }
+
+    // Fingerprint
+    //  - OS build, system DPI, theme, non-client, icon and minimized metrics, settings-driven
+    //    metrics that are not derived from DPI, and display configuration
+    //  - monitor DPIs don't need to be covered, records are keyed by DPI
+    //
+    std::uint64_t Fingerprint () const {
+        struct {
+            DWORD            build;
+            UINT             dpiSystem;
+            BOOL             themed;
+            wchar_t          theme [MAX_PATH];
+            wchar_t          color [64];
+            wchar_t          size [64];
+            NONCLIENTMETRICS ncm;
+            ICONMETRICS      icons;
+            MINIMIZEDMETRICS minimized;
+            int              settings [16];
+            int              display [8];
+        } fp;
+
+        ZeroMemory (&fp, sizeof fp);
+
+        RTL_OSVERSIONINFOW version;
+        version.dwOSVersionInfoSize = sizeof version;
+        if (ptrRtlGetVersion && ptrRtlGetVersion (&version) == 0) {
+            fp.build = version.dwBuildNumber;
+        }
+        fp.dpiSystem = GetDPI (NULL);
+        fp.themed = IsThemeActive ();
+        if (fp.themed) {
+            GetCurrentThemeName (fp.theme, MAX_PATH, fp.color, 64, fp.size, 64);
+        }
+        fp.ncm.cbSize = sizeof fp.ncm;
+        SystemParametersInfo (SPI_GETNONCLIENTMETRICS, sizeof fp.ncm, &fp.ncm, 0);
+        fp.icons.cbSize = sizeof fp.icons;
+        SystemParametersInfo (SPI_GETICONMETRICS, sizeof fp.icons, &fp.icons, 0);
+        fp.minimized.cbSize = sizeof fp.minimized;
+        SystemParametersInfo (SPI_GETMINIMIZEDMETRICS, sizeof fp.minimized, &fp.minimized, 0);
+
+        static const int settings [] = {
+            SM_SWAPBUTTON, SM_CXDOUBLECLK, SM_CYDOUBLECLK, SM_CXDRAG, SM_CYDRAG,
+            SM_CXFOCUSBORDER, SM_CYFOCUSBORDER, SM_CONVERTIBLESLATEMODE, SM_SYSTEMDOCKED,
+            SM_MOUSEPRESENT, SM_CMOUSEBUTTONS, SM_MOUSEWHEELPRESENT, SM_DIGITIZER, SM_MAXIMUMTOUCHES,
+            SM_TABLETPC, SM_MENUDROPALIGNMENT
+        };
+        static_assert (sizeof settings / sizeof settings [0] == sizeof fp.settings / sizeof fp.settings [0]);
+        for (auto i = 0u; i != sizeof settings / sizeof settings [0]; ++i) {
+            fp.settings [i] = GetSystemMetrics (settings [i]);
+        }
+
+        static const int display [] = {
+            SM_CMONITORS, SM_XVIRTUALSCREEN, SM_YVIRTUALSCREEN, SM_CXVIRTUALSCREEN, SM_CYVIRTUALSCREEN,
+            SM_CXSCREEN, SM_CYSCREEN, SM_REMOTESESSION
+        };
+        for (auto i = 0u; i != sizeof display / sizeof display [0]; ++i) {
+            fp.display [i] = GetSystemMetrics (display [i]);
+        }
+        return VisualCacheFormat::Fnv1a (&fp, sizeof fp);
+    }
+
+} VisualCache;
+
+// VisualsBackend
+//  - what Window's BasicVisuals needs from the system, VisualCache, ThemeCache and TextScale,
+//    see win32-dpi-visuals.hpp
+//
+struct VisualsBackend {
+    using Window = HWND;
+    using Font = LOGFONT;
+    using Gdi = GdiBackend;
+    using Controls = UpdateBackend;
+
+    static constexpr int MetricsCount = SM_CMETRICS;
+    static constexpr auto & LiveMetrics = VisualCache::LiveMetrics;
+    static constexpr int CxIcon = SM_CXICON;
+    static constexpr int CyIcon = SM_CYICON;
+    static constexpr int CxSmallIcon = SM_CXSMICON;
+    static constexpr int CySmallIcon = SM_CYSMICON;
+    static constexpr int CyBorder = SM_CYBORDER;
+
+    static constexpr unsigned SmallIcon = ICON_SMALL;
+    static constexpr unsigned BigIcon = ICON_BIG;
+    static constexpr unsigned SmallIcon2 = ICON_SMALL2;
+    static constexpr unsigned OkButton = IDOK;
+
+    static UINT SystemDpi () {
+        return GetDPI (NULL);
+    }
+    static int Metric (int index, long dpi, UINT dpiSystem) {
+        if (ptrGetSystemMetricsForDpi) {
+            return ptrGetSystemMetricsForDpi (index, dpi);
+        } else
+            return dpi * GetSystemMetrics (index) / dpiSystem;
+    }
+    static bool IsWindows10 () {
+        return IsWindows10OrGreater ();
+    }
+
+    static const VisualCache::Record * Find (long dpi) {
+        return VisualCache.Find (dpi);
+    }
+    static void Store (const VisualCache::Record & record) {
+        VisualCache.Store (record);
+    }
+    static VisualCacheFormat::Font Pack (const LOGFONT & lf) {
+        return VisualCache::Pack (lf);
+    }
+    static LOGFONT Unpack (const VisualCacheFormat::Font & font) {
+        return VisualCache::Unpack (font);
+    }
+
+    static bool TextFont (HWND hWnd, long dpi, LOGFONT & lf) {
+        return ThemeCache.GetSysFont (hWnd, L"TEXTSTYLE", dpi, TMT_MSGBOXFONT, lf);
+    }
+    static bool TitleFont (HWND hWnd, long dpi, LOGFONT & lf) {
+        return ThemeCache.GetFont (hWnd, L"TEXTSTYLE", dpi, TEXT_MAININSTRUCTION, 0, TMT_FONT, lf);
+    }
+    static bool DefaultFont (LOGFONT & lf) {
+        return GetObject (GetStockObject (DEFAULT_GUI_FONT), sizeof lf, &lf);
+    }
+    static void Scale (LOGFONT & lf, long dpi, UINT dpiSystem) {
+        lf.lfHeight = MulDiv (lf.lfHeight, dpi, dpiSystem);
+    }
+    static void Bold (LOGFONT & lf) {
+        lf.lfWeight = FW_BOLD;
+    }
+
+    static void ApplyTextScale (LOGFONT & lf) {
+        TextScale.Apply (lf);
+    }
+    static DWORD TextScaleFactor () {
+        return TextScale.current;
+    }
+};
+
+struct Window {
+    const HWND hWnd;
+private:
+    BasicVisuals <VisualsBackend> visuals;
+    HCURSOR cursor = NULL;
+
+    explicit Window (HWND hWnd)
+        : hWnd (hWnd)
+        , visuals (hWnd, GetDPI (hWnd)) {};
 
     static inline UINT_PTR idGlobalRefreshTimer;
+    static inline UINT_PTR idResourcePressureTimer;
     static constexpr USHORT WM_GlobalRefresh = WM_APP + 0x1234; // choose message that doesn't clash with others in application 
+    static constexpr USHORT WM_GlobalTrim = WM_APP + 0x1235;
 
     static void CALLBACK GuiChangesCoalescingTimer (HWND hWnd, UINT, UINT_PTR id, DWORD) {
         idGlobalRefreshTimer = 0;
@@ -377,12 +689,34 @@ private:
 
         // we can refresh DPI-independent and window-independent resources only once here
 
+        VisualCache.Validate ();
+
         EnumThreadWindows (GetCurrentThreadId (),
                            [] (HWND hWnd, LPARAM)->BOOL {
                                return PostMessage (hWnd, WM_GlobalRefresh, 0, 0);
                            }, 0);
     }
 
+    static void CALLBACK ResourcePressureTimer (HWND, UINT, UINT_PTR id, DWORD) {
+        idResourcePressureTimer = 0;
+        KillTimer (NULL, id);
+
+        Resources.RunScheduled ();
+    }
+
+    // Trim
+    //  - releases everything, in all windows and shared caches, not used since 'before' tick
+    //  - called by Resources, when over soft budget and when allocation wouldn't fit into hard budget
+    //
+    static void Trim (UINT before) {
+        ThemeCache.Trim (before);
+        EnumThreadWindows (GetCurrentThreadId (),
+                           [] (HWND hWnd, LPARAM before)->BOOL {
+                               SendMessage (hWnd, WM_GlobalTrim, 0, before);
+                               return TRUE;
+                           }, (LPARAM) before);
+    }
+
 public:
     static LPCTSTR Initialize (HINSTANCE hInstance) {
         WNDCLASSEX wndclass = {
@@ -390,6 +724,8 @@ public:
             Procedure, 0, 0, hInstance,  NULL,
             NULL, NULL, NULL, L"EXAMPLE", NULL
         };
+        Resources.schedule = [] () { idResourcePressureTimer = SetTimer (NULL, 0, 0, ResourcePressureTimer); };
+        Resources.trim = Trim;
         return (LPCTSTR) (std::intptr_t) RegisterClassEx (&wndclass);
     }
 
@@ -400,7 +736,8 @@ private:
                 if (ptrEnableNonClientDpiScaling) {
                     ptrEnableNonClientDpiScaling (hWnd); // required for v1 per-monitor scaling
                 }
-                this->RefreshVisualMetrics ();
+                this->visuals.RefreshMetrics ();
+                StartupTrace.Event (L"WM_NCCREATE");
                 break;
             case WM_CREATE:
                 try {
@@ -420,30 +757,8 @@ private:
                 break;
 
             case WM_GETICON:
-                if (lParam && (lParam != this->dpi)) {
-
-                    // OS (taskbars on different displays) or other app asked for icon in different DPI
-                    if (auto [found, data] = this->icons.find_in_dpi_cache (wParam, lParam); found) {
-                        return (LRESULT) data->icon;
-
-                    } else {
-                        auto ndpi = (long) lParam;
-                        auto size = GetIconMetrics (this->MapIconSize (wParam));
-                        auto icon = LoadBestIcon (reinterpret_cast <HINSTANCE> (&__ImageBase), MAKEINTRESOURCE (1),
-                                                  { ndpi * size.cx / 96, ndpi * size.cy / 96 });
-                        if (data) {
-                            data->type = wParam;
-                            data->dpi = ndpi;
-                            data->icon = icon;
-                        }
-                        return (LRESULT) icon;
-                    }
-                } else {
-                    switch (wParam) {
-                        case ICON_SMALL2:
-                            return (LRESULT) this->icons.standard [this->MapIconSize (wParam)];
-                    }
-                }
+                if (auto hIcon = this->visuals.GetIcon (UINT (wParam), long (lParam)))
+                    return (LRESULT) hIcon;
                 break;
 
             case WM_DPICHANGED:
@@ -452,14 +767,32 @@ private:
                 return this->OnPositionChange (*reinterpret_cast <const WINDOWPOS *> (lParam));
 
             case WM_THEMECHANGED:
+                ThemeCache.Invalidate ();
+                return this->OnPresentationChangeNotification ();
             case WM_SETTINGCHANGE:
+                ThemeCache.InvalidateSystemFonts ();
+                return this->OnPresentationChangeNotification ();
+            case WM_DISPLAYCHANGE:
             case WM_DWMCOMPOSITIONCHANGED:
                 return this->OnPresentationChangeNotification ();
 
             case WM_GlobalRefresh:
-                this->OnVisualEnvironmentChange ();
-                InvalidateRect (hWnd, NULL, TRUE);
+                this->OnVisualEnvironmentChange (true);
+                break;
+
+            // resource pressure
+
+            case WM_SIZE:
+                if (wParam == SIZE_MINIMIZED) {
+                    this->visuals.Trim (Resources.Now () + 1);
+                }
+                break;
+            case WM_COMPACTING:
+                Resources.Schedule (true);
                 break;
+            case WM_GlobalTrim:
+                this->visuals.Trim (UINT (lParam));
+                return 0;
 
             case WM_MOUSEMOVE:
                 SetCursor (this->cursor);
@@ -490,22 +823,20 @@ private:
         CreateWindow (L"STATIC", L"", WS_VISIBLE | WS_CHILD | WS_BORDER | SS_CENTER, 0,0,0,0, hWnd, (HMENU) 101, cs->hInstance, NULL);
         CreateWindow (L"STATIC", L"", WS_VISIBLE | WS_CHILD | SS_CENTER, 0,0,0,0, hWnd, (HMENU) 102, cs->hInstance, NULL);
         CreateWindow (L"BUTTON", L"BUTTON", WS_VISIBLE | WS_CHILD | WS_TABSTOP, 0,0,0,0, hWnd, (HMENU) IDOK, cs->hInstance, NULL);
-        this->dpi = GetDPI (this->hWnd);
+        this->visuals.dpi = GetDPI (this->hWnd);
         this->OnVisualEnvironmentChange ();
+        StartupTrace.Event (L"WM_CREATE");
         return 0;
     }
     LRESULT OnDestroy () {
-        for (auto icon : this->icons.standard) {
-            DestroyIcon (icon);
-        }
         PostQuitMessage (0);
         return 0;
     }
     LRESULT OnDpiChange (WPARAM dpi, const RECT * r) {
         dpi = LOWORD (dpi);
-        if (this->dpi != dpi) {
+        if (this->visuals.dpi != long (dpi)) {
             // percentual anchors and such are recomputed here
-            this->dpi = long (dpi);
+            this->visuals.dpi = long (dpi);
         }
 
         this->OnVisualEnvironmentChange ();
@@ -516,161 +847,21 @@ private:
         idGlobalRefreshTimer = SetTimer (NULL, idGlobalRefreshTimer, 500, GuiChangesCoalescingTimer);
         return 0;
     }
-    LRESULT OnVisualEnvironmentChange () {
-        auto dpiSystem = GetDPI (NULL);
-        auto hTheme = OpenThemeData (hWnd, L"TEXTSTYLE");
-
-        // theme-dependent stuff gets reloaded here
-        //  - note that hTheme can be NULL when XP,Vista,7 is in classic mode
-        //    or when compatibility mode is imposed onto the window
-
-        LOGFONT lf;
-        if (GetThemeSysFont (hTheme, TMT_MSGBOXFONT, &lf) == S_OK) {
-            lf.lfHeight = MulDiv (lf.lfHeight, this->dpi, dpiSystem);
-            TextScale.Apply (lf);
-            this->fonts.text.update (lf);
-        } else {
-            if (GetObject (GetStockObject (DEFAULT_GUI_FONT), sizeof lf, &lf)) {
-                lf.lfHeight = MulDiv (lf.lfHeight, this->dpi, dpiSystem);
-                TextScale.Apply (lf);
-                this->fonts.text.update (lf);
-            }
-        }
-        if (GetThemeFont (hTheme, NULL, TEXT_MAININSTRUCTION, 0, TMT_FONT, &lf) == S_OK) {
-            if (!AreDpiApisScaled (this->hWnd)) {
-                lf.lfHeight = MulDiv (lf.lfHeight, this->dpi, dpiSystem);
-            }
-            TextScale.Apply (lf);
-            this->fonts.title.update (lf);
-        } else {
-            // themes off or unavailable, reuse above one and make it bold
-            lf.lfWeight = FW_BOLD;
-            lf.lfHeight = MulDiv (lf.lfHeight, this->dpi, dpiSystem);
-            TextScale.Apply (lf);
-            this->fonts.title.update (lf);
-        }
-
-        if (hTheme) {
-            CloseThemeData (hTheme);
-        }
-
-        // display text size
-
-        wchar_t text [64];
-        swprintf (text, 64, L"%ld px TITLE", this->fonts.title.height);
-        SetDlgItemText (hWnd, 100, text);
-
-        swprintf (text, 64, L"%ld px text characters test: \x158\xB3 \x338 \x2211 \xBEB\xA675:", this->fonts.text.height);
-        SetDlgItemText (hWnd, 101, text);
-
-        swprintf (text, 64, L"Text scale factor: %lu", TextScale.current);
-        SetDlgItemText (hWnd, 102, text);
-
-        // set the new font(s) to appropriate children
-
-        SendDlgItemMessage (hWnd, 100, WM_SETFONT, (WPARAM) this->fonts.title.handle, 1);
-        SendDlgItemMessage (hWnd, 101, WM_SETFONT, (WPARAM) this->fonts.text.handle, 1);
-        SendDlgItemMessage (hWnd, 102, WM_SETFONT, (WPARAM) this->fonts.text.handle, 1);
-        SendDlgItemMessage (hWnd, IDOK, WM_SETFONT, (WPARAM) this->fonts.text.handle, 1);
-
-        // refresh everthing else
-
+    // OnVisualEnvironmentChange
+    //  - 'settings' is true when refreshing after system settings change, see BasicVisuals::Refresh
+    //
+    LRESULT OnVisualEnvironmentChange (bool settings = false) {
+        this->visuals.Refresh (settings);
         this->cursor = LoadCursor (NULL, IDC_ARROW);
-        this->RefreshVisualMetrics (dpiSystem);
-
-        // DPI changes also size of window icons
-
-        for (auto i = 0u; i != IconSizesCount; ++i) {
-            if (auto icon = LoadBestIcon (reinterpret_cast <HINSTANCE> (&__ImageBase), MAKEINTRESOURCE (1),
-                                          GetIconMetrics ((IconSize) i, dpiSystem))) {
-                if (this->icons.standard [i]) {
-                    DestroyIcon (this->icons.standard [i]);
-                }
-                this->icons.standard [i] = icon;
-            }
-        }
-
-        // drop DPI-specific icon cache
-
-        for (auto & item : this->icons.dpi_cache) {
-            if (item.icon) {
-                DestroyIcon (item.icon);
-
-                item.type = 0;
-                item.dpi = 0;
-                item.icon = NULL;
-            }
-        }
-
-        // set primary pair of icons for the window
-
-        SendMessage (hWnd, WM_SETICON, ICON_SMALL, (LPARAM) this->icons.standard [MapIconSize (ICON_SMALL)]);
-        SendMessage (hWnd, WM_SETICON, ICON_BIG, (LPARAM) this->icons.standard [MapIconSize (ICON_BIG)]);
-
         return 0;
     }
 
-    void DeferChildPos (HDWP & hDwp, UINT id, const POINT & position, const SIZE & size, UINT flags = 0) {
-        hDwp = DeferWindowPos (hDwp, GetDlgItem (this->hWnd, id), NULL,
-                               position.x, position.y, size.cx, size.cy,
-                               SWP_NOACTIVATE | SWP_NOZORDER | flags);
-    }
-
     LRESULT OnPositionChange (const WINDOWPOS & position) {
         if (!(position.flags & SWP_NOSIZE) || (position.flags & (SWP_SHOWWINDOW | SWP_FRAMECHANGED))) {
 
             RECT client;
             if (GetClientRect (hWnd, &client)) {
-                if (HDWP hDwp = BeginDeferWindowPos (2)) {
-                    POINT center = { client.right / 2, client.bottom / 2 };
-
-                    // use a little larger than recommended size from uxguide: https://docs.microsoft.com/en-us/windows/win32/uxguide/ctrl-command-buttons
-                    SIZE sizeButton = {
-                        (85 * this->dpi * TextScale.current) / (96 * 100),
-                        (25 * this->dpi * TextScale.current) / (96 * 100)
-                    };
-                    // center it
-                    POINT posButton = {
-                        center.x - sizeButton.cx / 2,
-                        center.y - sizeButton.cy / 2,
-                    };
-
-                    DeferChildPos (hDwp, IDOK, posButton, sizeButton);
-
-                    // make the label height fit the font tightly + the border
-                    SIZE sizeLabel = {
-                        client.right,
-                        this->fonts.text.height + 2 * this->metrics [SM_CYBORDER]
-                    };
-                    POINT posLabel = {
-                        0,
-                        posButton.y - sizeLabel.cy - (4 * this->dpi / 96) // uxguide says 4px spacing
-                    };
-                    DeferChildPos (hDwp, 101, posLabel, sizeLabel);
-
-                    SIZE sizeLabel2 = {
-                        client.right,
-                        this->fonts.text.height + 2 * this->metrics [SM_CYBORDER]
-                    };
-                    POINT posLabel2 = {
-                        0,
-                        posButton.y + sizeButton.cy + (4 * this->dpi / 96)
-                    };
-                    DeferChildPos (hDwp, 102, posLabel2, sizeLabel2);
-
-                    // title
-                    SIZE sizeTitle = {
-                        client.right / 3,
-                        this->fonts.title.height
-                    };
-                    POINT posTitle = {
-                        client.right / 3,
-                        posLabel.y - sizeTitle.cy - (7 * this->dpi / 96)
-                    };
-                    DeferChildPos (hDwp, 100, posTitle, sizeTitle);
-
-                    EndDeferWindowPos (hDwp);
-                }
+                this->visuals.Layout (client.right, client.bottom);
             }
         }
         return 0;
@@ -708,51 +899,100 @@ private:
     }
 };
 
-int CALLBACK wWinMain (_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR, _In_ int nCmdShow) {
-    InitCommonControls ();
-    
-    if (HMODULE hUser32 = GetModuleHandle (L"USER32")) {
-        Symbol (hUser32, ptrEnableNonClientDpiScaling, "EnableNonClientDpiScaling");
-        Symbol (hUser32, pfnGetDpiForSystem, "GetDpiForSystem");
-        Symbol (hUser32, pfnGetDpiForWindow, "GetDpiForWindow");
-        Symbol (hUser32, ptrGetSystemMetricsForDpi, "GetSystemMetricsForDpi");
-        Symbol (hUser32, ptrGetWindowDpiAwarenessContext, "GetWindowDpiAwarenessContext");
-        Symbol (hUser32, ptrAreDpiAwarenessContextsEqual, "AreDpiAwarenessContextsEqual");
-    }
-    if (HMODULE hComCtl32 = GetModuleHandle (L"COMCTL32")) {
-        Symbol (hComCtl32, ptrLoadIconWithScaleDown, "LoadIconWithScaleDown");
-    }
-
-    if (auto atom = Window::Initialize (hInstance)) {
-        static const auto D = CW_USEDEFAULT;
-        if (auto hWnd = CreateWindow (atom, L"Win32 DPI-aware window example",
-                                      WS_OVERLAPPEDWINDOW | WS_CLIPCHILDREN,
-                                      D, D, D, D, HWND_DESKTOP, NULL, hInstance, NULL)) {
-
-            if (TextScale.Initialize ()) {
-                HANDLE hThreadPoolWait = NULL;
-                RegisterWaitForSingleObject (&hThreadPoolWait, TextScale.hEvent,
-                                             [] (PVOID hWnd, BOOLEAN) {
-                                                 if (TextScale.OnEvent ()) {
-                                                     SendMessage ((HWND) hWnd, WM_SETTINGCHANGE, 0, 0);
-                                                 }
-                                             }, hWnd, INFINITE, 0);
-            }
-                
-            ShowWindow (hWnd, nCmdShow);
+// StartupBackend
+//  - Win32 side of BasicStartup, see win32-dpi-startup.hpp
+//  - 'hWnd' is set by CreateMainWindow, Idle is called with it from the timer
+//
+struct StartupBackend {
+    HINSTANCE hInstance;
+    int       nCmdShow;
+    HWND      hWnd = NULL;
 
-            MSG message;
-            message.wParam = 0;
+    void Event (const wchar_t * event) {
+        StartupTrace.Event (event);
+    }
+    void LoadSymbols () {
+        InitCommonControls ();
+
+        if (HMODULE hUser32 = GetModuleHandle (L"USER32")) {
+            Symbol (hUser32, ptrEnableNonClientDpiScaling, "EnableNonClientDpiScaling");
+            Symbol (hUser32, pfnGetDpiForSystem, "GetDpiForSystem");
+            Symbol (hUser32, pfnGetDpiForWindow, "GetDpiForWindow");
+            Symbol (hUser32, ptrGetSystemMetricsForDpi, "GetSystemMetricsForDpi");
+            Symbol (hUser32, ptrGetWindowDpiAwarenessContext, "GetWindowDpiAwarenessContext");
+            Symbol (hUser32, ptrAreDpiAwarenessContextsEqual, "AreDpiAwarenessContextsEqual");
+        }
+        if (HMODULE hComCtl32 = GetModuleHandle (L"COMCTL32")) {
+            Symbol (hComCtl32, ptrLoadIconWithScaleDown, "LoadIconWithScaleDown");
+        }
+        if (HMODULE hUxTheme = GetModuleHandle (L"UXTHEME")) {
+            Symbol (hUxTheme, ptrOpenThemeDataForDpi, "OpenThemeDataForDpi");
+        }
+        if (HMODULE hNtDll = GetModuleHandle (L"NTDLL")) {
+            Symbol (hNtDll, ptrRtlGetVersion, "RtlGetVersion");
+        }
+    }
+    bool MapVisualCache () {
+        return VisualCache.Initialize ();
+    }
+    bool ReadTextScale () {
+        return TextScale.Initialize ();
+    }
+    bool CreateMainWindow () {
+        if (auto atom = Window::Initialize (this->hInstance)) {
+            static const auto D = CW_USEDEFAULT;
+            this->hWnd = CreateWindow (atom, L"Win32 DPI-aware window example",
+                                       WS_OVERLAPPEDWINDOW | WS_CLIPCHILDREN,
+                                       D, D, D, D, HWND_DESKTOP, NULL, this->hInstance, NULL);
+        }
+        return this->hWnd != NULL;
+    }
+    void ShowMainWindow () {
+        ShowWindow (this->hWnd, this->nCmdShow);
+    }
 
-            while (GetMessage (&message, NULL, 0u, 0u)) {
-                if (!IsDialogMessage (GetAncestor (message.hwnd, GA_ROOT), &message)) {
-                    TranslateMessage (&message);
-                    DispatchMessage (&message);
-                }
+    // ScheduleIdle
+    //  - WM_TIMER is generated only when there are no other messages, including WM_PAINT, pending
+    //
+    void ScheduleIdle () {
+        SetTimer (this->hWnd, 1, USER_TIMER_MINIMUM,
+                  [] (HWND hWnd, UINT, UINT_PTR id, DWORD) {
+                      KillTimer (hWnd, id);
+                      BasicStartup <StartupBackend> ({ NULL, 0, hWnd }).Idle ();
+                  });
+    }
+    void WatchTextScale () {
+        if (TextScale.hEvent) {
+            HANDLE hThreadPoolWait = NULL;
+            RegisterWaitForSingleObject (&hThreadPoolWait, TextScale.hEvent,
+                                         [] (PVOID hWnd, BOOLEAN) {
+                                             if (TextScale.OnEvent ()) {
+                                                 SendMessage ((HWND) hWnd, WM_SETTINGCHANGE, 0, 0);
+                                             }
+                                         }, this->hWnd, INFINITE, 0);
+        }
+    }
+    void FlushVisualCache () {
+        VisualCache.Flush ();
+    }
+};
+
+int CALLBACK wWinMain (_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow) {
+    StartupTrace.Initialize (lpCmdLine);
+
+    if (BasicStartup <StartupBackend> ({ hInstance, nCmdShow }).Run ()) {
+        MSG message;
+        message.wParam = 0;
+
+        while (GetMessage (&message, NULL, 0u, 0u)) {
+            if (!IsDialogMessage (GetAncestor (message.hwnd, GA_ROOT), &message)) {
+                TranslateMessage (&message);
+                DispatchMessage (&message);
             }
-            
-            return (int) message.wParam;
         }
+
+        VisualCache.Flush ();
+        return (int) message.wParam;
     }
     return (int) GetLastError ();
 }